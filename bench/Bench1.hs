@@ -0,0 +1,66 @@
+module Main where
+
+import Graphics.QML
+
+import Foreign.C.Types
+import Foreign.Ptr
+import Foreign.StablePtr
+import System.Directory
+import System.Environment
+import System.IO
+
+foreign import ccall "hsqml_bench_object_set"
+    benchObjectSet :: CInt -> IO ()
+
+foreign import ccall "hsqml_bench_event_thread"
+    benchEventThread :: IO ()
+
+foreign import ccall "hsqml_bench_run_state"
+    benchRunState :: IO ()
+
+foreign import ccall "hsqml_bench_pool"
+    benchPool :: IO ()
+
+foreign import ccall "hsqml_bench_ffi"
+    benchFFI :: FunPtr (IO (StablePtr ())) -> IO ()
+
+foreign import ccall "wrapper"
+    newStableFun :: IO (StablePtr ()) -> IO (FunPtr (IO (StablePtr ())))
+
+benchQml :: String
+benchQml = unlines [
+    "import QtQuick 2.0",
+    "Item {",
+    "    Component.onCompleted: {",
+    "        runBench();",
+    "        Qt.quit();",
+    "    }",
+    "}"]
+
+-- Benchmarks of the manager and the FFI run inside a method called from QML
+-- so that the event loop is running and there is an active engine, with the
+-- offscreen platform so that no display is needed.
+runLoopBenches :: IO ()
+runLoopBenches = do
+    setEnv "QT_QPA_PLATFORM" "offscreen"
+    newStable <- newStableFun $ newStablePtr ()
+    clazz <- newClass [defMethod' "runBench" $ \_ -> do
+        benchEventThread
+        benchRunState
+        benchFFI newStable]
+    obj <- newObject clazz ()
+    tmpDir <- getTemporaryDirectory
+    (qmlPath, hndl) <- openTempFile tmpDir "bench1-.qml"
+    hPutStr hndl benchQml
+    hClose hndl
+    runEngineLoop defaultEngineConfig {
+        initialDocument = fileDocument qmlPath,
+        contextObject = Just $ anyObjRef obj}
+    removeFile qmlPath
+    freeHaskellFunPtr newStable
+
+main :: IO ()
+main = do
+    mapM_ benchObjectSet [10000, 100000, 1000000]
+    benchPool
+    runLoopBenches
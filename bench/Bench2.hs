@@ -0,0 +1,273 @@
+{-# LANGUAGE DeriveDataTypeable, TypeFamilies #-}
+
+module Main where
+
+import Graphics.QML
+import Graphics.QML.Test.Harness
+import Graphics.QML.Test.ScriptDSL (Expr, Prog)
+import qualified Graphics.QML.Test.ScriptDSL as S
+
+import Control.Monad
+import Data.IORef
+import Data.Monoid
+import Data.Proxy
+import Data.Typeable
+import Data.Word
+import GHC.Clock
+import System.Environment
+import System.IO
+import Text.Printf
+
+import Data.Text (Text)
+import qualified Data.Text as T
+
+-- Marshalled values per measurement, divided between the calls
+cOps :: Int
+cOps = 100000
+
+-- Sizes of the text and list payloads
+cSizes :: [Int]
+cSizes = [1, 16, 256, 4096]
+
+data Bench = Bench {
+    benchStartTime :: IORef Word64,
+    benchInt       :: IORef Int,
+    benchText      :: IORef Text,
+    benchList      :: IORef [Int]
+} deriving Typeable
+
+data NoArgsSignal deriving Typeable
+
+instance SignalKeyClass NoArgsSignal where
+    type SignalParams NoArgsSignal = IO ()
+
+data IntSignal deriving Typeable
+
+instance SignalKeyClass IntSignal where
+    type SignalParams IntSignal = Int -> IO ()
+
+data TextSignal deriving Typeable
+
+instance SignalKeyClass TextSignal where
+    type SignalParams TextSignal = Text -> IO ()
+
+data ListSignal deriving Typeable
+
+instance SignalKeyClass ListSignal where
+    type SignalParams ListSignal = [Int] -> IO ()
+
+data DoneSignal deriving Typeable
+
+instance SignalKeyClass DoneSignal where
+    type SignalParams DoneSignal = IO ()
+
+benchStart :: ObjRef Bench -> IO ()
+benchStart this =
+    getMonotonicTimeNSec >>= writeIORef (benchStartTime $ fromObjRef this)
+
+-- Prints one result line in the same format as the C++ benchmarks.
+benchStop :: ObjRef Bench -> Text -> Int -> Int -> IO ()
+benchStop this name size ops = do
+    end <- getMonotonicTimeNSec
+    start <- readIORef $ benchStartTime $ fromObjRef this
+    let nsecs = fromIntegral (end - start) :: Double
+    printf "%-32s %9d %10.2f ns/op\n"
+        (T.unpack name) size (nsecs / fromIntegral (max 1 ops))
+    hFlush stdout
+
+-- Signals are delivered by jobs on the event loop, so each batch is followed
+-- by a signal which lets the script know that the batch has been received.
+fireBatch :: ObjRef Bench -> Int -> IO () -> IO ()
+fireBatch this n fire = do
+    replicateM_ n fire
+    fireSignal (Proxy :: Proxy DoneSignal) this
+
+type Arg = Int
+
+method0 :: ObjRef Bench -> IO ()
+method0 _ = return ()
+
+method1 :: ObjRef Bench -> Arg -> IO ()
+method1 _ _ = return ()
+
+method2 :: ObjRef Bench -> Arg -> Arg -> IO ()
+method2 _ _ _ = return ()
+
+method3 :: ObjRef Bench -> Arg -> Arg -> Arg -> IO ()
+method3 _ _ _ _ = return ()
+
+method4 :: ObjRef Bench -> Arg -> Arg -> Arg -> Arg -> IO ()
+method4 _ _ _ _ _ = return ()
+
+method5 :: ObjRef Bench -> Arg -> Arg -> Arg -> Arg -> Arg -> IO ()
+method5 _ _ _ _ _ _ = return ()
+
+method6 :: ObjRef Bench -> Arg -> Arg -> Arg -> Arg -> Arg -> Arg -> IO ()
+method6 _ _ _ _ _ _ _ = return ()
+
+method7 ::
+    ObjRef Bench -> Arg -> Arg -> Arg -> Arg -> Arg -> Arg -> Arg -> IO ()
+method7 _ _ _ _ _ _ _ _ = return ()
+
+method8 :: ObjRef Bench ->
+    Arg -> Arg -> Arg -> Arg -> Arg -> Arg -> Arg -> Arg -> IO ()
+method8 _ _ _ _ _ _ _ _ _ = return ()
+
+echo :: ObjRef Bench -> a -> IO a
+echo _ = return
+
+instance DefaultClass Bench where
+    classMembers = [
+        defMethod "benchStart" benchStart,
+        defMethod "benchStop" benchStop,
+        defMethod "echoInt" (echo :: ObjRef Bench -> Int -> IO Int),
+        defMethod "echoDouble" (echo :: ObjRef Bench -> Double -> IO Double),
+        defMethod "echoText" (echo :: ObjRef Bench -> Text -> IO Text),
+        defMethod "echoMaybe"
+            (echo :: ObjRef Bench -> Maybe Int -> IO (Maybe Int)),
+        defMethod "echoIntList" (echo :: ObjRef Bench -> [Int] -> IO [Int]),
+        defMethod "echoTextList" (echo :: ObjRef Bench -> [Text] -> IO [Text]),
+        defMethod "echoObject"
+            (echo :: ObjRef Bench -> ObjRef Bench -> IO (ObjRef Bench)),
+        defMethod "echoAnyObject"
+            (echo :: ObjRef Bench -> AnyObjRef -> IO AnyObjRef),
+        defMethod "getObject" (return :: ObjRef Bench -> IO (ObjRef Bench)),
+        defMethod "method0" method0,
+        defMethod "method1" method1,
+        defMethod "method2" method2,
+        defMethod "method3" method3,
+        defMethod "method4" method4,
+        defMethod "method5" method5,
+        defMethod "method6" method6,
+        defMethod "method7" method7,
+        defMethod "method8" method8,
+        defPropertyRW "intProp"
+            (readIORef . benchInt . fromObjRef)
+            (writeIORef . benchInt . fromObjRef),
+        defPropertyRW "textProp"
+            (readIORef . benchText . fromObjRef)
+            (writeIORef . benchText . fromObjRef),
+        defPropertyRW "listProp"
+            (readIORef . benchList . fromObjRef)
+            (writeIORef . benchList . fromObjRef),
+        defSignal "noArgsSignal" (Proxy :: Proxy NoArgsSignal),
+        defSignal "intSignal" (Proxy :: Proxy IntSignal),
+        defSignal "textSignal" (Proxy :: Proxy TextSignal),
+        defSignal "listSignal" (Proxy :: Proxy ListSignal),
+        defSignal "doneSignal" (Proxy :: Proxy DoneSignal),
+        defMethod "fireNoArgs" $ \this n -> fireBatch this n $
+            fireSignal (Proxy :: Proxy NoArgsSignal) this,
+        defMethod "fireInt" $ \this n v -> fireBatch this n $
+            fireSignal (Proxy :: Proxy IntSignal) this (v :: Int),
+        defMethod "fireText" $ \this n v -> fireBatch this n $
+            fireSignal (Proxy :: Proxy TextSignal) this (v :: Text),
+        defMethod "fireList" $ \this n v -> fireBatch this n $
+            fireSignal (Proxy :: Proxy ListSignal) this (v :: [Int])]
+
+global :: String -> Expr
+global = S.dot (S.var 0)
+
+callGlobal :: String -> [Expr] -> Prog
+callGlobal name es = S.eval $ global name `S.call` es
+
+textPayload :: Int -> Text
+textPayload n = T.pack $ take n $ cycle ['a'..'z']
+
+listPayload :: Int -> [Int]
+listPayload n = [1..n]
+
+-- Number of calls made when each carries a payload of the given size.
+opsFor :: Int -> Int
+opsFor size = max 16 $ cOps `div` size
+
+stopBench :: String -> Int -> Int -> Prog
+stopBench name size n =
+    callGlobal "benchStop" [S.literal $ T.pack name, S.literal size,
+        S.literal n]
+
+-- Times a statement run repeatedly in a loop.
+timed :: String -> Int -> Int -> Prog -> Prog
+timed name size n body =
+    callGlobal "benchStart" [] <> S.loop n body <>
+    stopBench name size n
+
+-- Times a batch of signals, continuing the rest of the script after the
+-- batch has been delivered.
+timedSignal :: String -> Int -> Int -> String -> [Expr] -> Prog
+timedSignal name size n fire es =
+    callGlobal "benchStart" [] <>
+    S.makeCont []
+        (S.connect (global "doneSignal") S.contVar <>
+         callGlobal fire (S.literal n : es)) <>
+    S.disconnect (global "doneSignal") S.callee <>
+    stopBench name size n
+
+echoBench :: String -> Int -> String -> Expr -> Prog
+echoBench name size method v =
+    S.saveVar 1 v <>
+    timed name size (opsFor size) (callGlobal method [S.var 1])
+
+marshalBenches :: Prog
+marshalBenches = mconcat $ [
+    echoBench "marshal/int" 1 "echoInt" $ S.literal (42 :: Int),
+    echoBench "marshal/double" 1 "echoDouble" $ S.literal (0.5 :: Double),
+    echoBench "marshal/maybe/null" 1 "echoMaybe" $
+        S.literal (Nothing :: Maybe Int),
+    echoBench "marshal/maybe/just" 1 "echoMaybe" $
+        S.literal (Just 42 :: Maybe Int),
+    S.saveVar 2 $ global "getObject" `S.call` [],
+    echoBench "marshal/object" 1 "echoObject" $ S.var 2,
+    echoBench "marshal/anyobject" 1 "echoAnyObject" $ S.var 2] ++
+    concatMap (\n -> [
+        echoBench "marshal/text" n "echoText" $ S.literal $ textPayload n,
+        echoBench "marshal/list/int" n "echoIntList" $
+            S.literal $ listPayload n,
+        echoBench "marshal/list/text" n "echoTextList" $
+            S.literal $ replicate n $ textPayload 16]) cSizes
+
+methodBenches :: Prog
+methodBenches = mconcat $ map (\n ->
+    timed "method/args" n cOps $ callGlobal ("method" ++ show n) $
+        map S.literal [1..n]) [0..8]
+
+propertyBenches :: Prog
+propertyBenches = mconcat $ [
+    timed "property/write/int" 1 cOps $
+        S.set (global "intProp") $ S.sym "i",
+    timed "property/read/int" 1 cOps $
+        S.saveVar 1 $ global "intProp"] ++
+    concatMap (\n -> [
+        S.saveVar 2 $ S.literal $ textPayload n,
+        timed "property/write/text" n (opsFor n) $
+            S.set (global "textProp") $ S.var 2,
+        timed "property/read/text" n (opsFor n) $
+            S.saveVar 1 $ global "textProp",
+        S.saveVar 2 $ S.literal $ listPayload n,
+        timed "property/write/list" n (opsFor n) $
+            S.set (global "listProp") $ S.var 2,
+        timed "property/read/list" n (opsFor n) $
+            S.saveVar 1 $ global "listProp"]) cSizes
+
+signalBenches :: Prog
+signalBenches = mconcat $ [
+    S.connect (global "noArgsSignal") $ S.sym "function() {}",
+    S.connect (global "intSignal") $ S.sym "function(v) {}",
+    S.connect (global "textSignal") $ S.sym "function(v) {}",
+    S.connect (global "listSignal") $ S.sym "function(v) {}",
+    timedSignal "signal/noargs" 0 cOps "fireNoArgs" [],
+    timedSignal "signal/int" 1 cOps "fireInt" [S.literal (42 :: Int)]] ++
+    concatMap (\n -> [
+        timedSignal "signal/text" n (opsFor n) "fireText"
+            [S.literal $ textPayload n],
+        timedSignal "signal/list" n (opsFor n) "fireList"
+            [S.literal $ listPayload n]]) cSizes
+
+main :: IO ()
+main = do
+    setEnv "QT_QPA_PLATFORM" "offscreen"
+    bench <- Bench <$> newIORef 0 <*> newIORef 0 <*> newIORef T.empty <*>
+        newIORef []
+    go <- newObjectDC bench
+    let prog = marshalBenches <> methodBenches <> propertyBenches <>
+            signalBenches <> S.end
+    runScript (S.showProg prog "") $ anyObjRef go
@@ -0,0 +1,31 @@
+#include <cstdio>
+
+#include "Bench.h"
+
+volatile quintptr gBenchSink = 0;
+
+void hsqmlBenchReport(const char* name, int size, qint64 nsecs, qint64 ops)
+{
+    std::printf("%-32s %9d %10.2f ns/op\n",
+        name, size, ops > 0 ? static_cast<double>(nsecs)/ops : 0.0);
+    std::fflush(stdout);
+}
+
+QVector<int> hsqmlBenchShuffle(int count)
+{
+    QVector<int> perm(count);
+    for (int i=0; i<count; i++) {
+        perm[i] = i;
+    }
+
+    // Fisher-Yates with a fixed xorshift generator
+    quint32 state = 0x2545F491;
+    for (int i=count-1; i>0; i--) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        int j = static_cast<int>(state % static_cast<quint32>(i+1));
+        qSwap(perm[i], perm[j]);
+    }
+    return perm;
+}
@@ -0,0 +1,21 @@
+#ifndef HSQML_BENCH_H
+#define HSQML_BENCH_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+
+// Prints one result line in a fixed format so that runs can be diffed.
+void hsqmlBenchReport(const char* name, int size, qint64 nsecs, qint64 ops);
+
+// Returns a reproducible permutation of [0,count) for randomising access.
+QVector<int> hsqmlBenchShuffle(int count);
+
+// Results are accumulated here to stop the compiler eliding the work.
+extern volatile quintptr gBenchSink;
+
+class QObject;
+
+// Benchmarks the manager's QVariant hooks with an object belonging to HsQML.
+void hsqmlBenchVariantHook(QObject*);
+
+#endif /*HSQML_BENCH_H*/
@@ -0,0 +1,64 @@
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QVariant>
+
+#include "Bench.h"
+#include "Manager.h"
+
+// Checks made per measurement
+static const int cChecks = 1 << 24;
+
+// Variants constructed and cleared per measurement
+static const int cVariants = 1 << 20;
+
+// The check made by the QVariant hooks before caching the thread identity
+static bool checkCurrentThread(const QObject* app)
+{
+    return app && app->thread() == QThread::currentThread();
+}
+
+// The check made by the QVariant hooks now
+static bool checkManager(const QObject*)
+{
+    return gManager->isEventThread();
+}
+
+// Qt calls the hooks through a function pointer, so do the same here to stop
+// the checks being inlined and hoisted out of the loop.
+typedef bool (*CheckFn)(const QObject*);
+
+static void benchCheck(const char* name, CheckFn fn, const QObject* app)
+{
+    CheckFn volatile check = fn;
+    QElapsedTimer timer;
+    quintptr hits = 0;
+    timer.start();
+    for (int i=0; i<cChecks; i++) {
+        hits += check(app);
+    }
+    gBenchSink = gBenchSink + hits;
+    hsqmlBenchReport(name, 1, timer.nsecsElapsed(), cChecks);
+}
+
+// Runs inside a method called from QML, so this is the event thread.
+extern "C" void hsqml_bench_event_thread()
+{
+    QObject app;
+    benchCheck("thread/check/currentThread", &checkCurrentThread, &app);
+    benchCheck("thread/check/manager", &checkManager, &app);
+
+    // Cost of a heap QVariant holding a pointer to an object which isn't
+    // HsQML's, for scale against the checks above.
+    QVariant** vars = new QVariant*[cVariants];
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cVariants; i++) {
+        vars[i] = new QVariant(QVariant::fromValue<QObject*>(&app));
+    }
+    for (int i=0; i<cVariants; i++) {
+        delete vars[i];
+    }
+    hsqmlBenchReport("thread/variant/baseline", 1,
+        timer.nsecsElapsed(), cVariants);
+    delete[] vars;
+}
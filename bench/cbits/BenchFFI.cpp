@@ -0,0 +1,326 @@
+#include <cstdlib>
+#include <cstring>
+#include <HsFFI.h>
+#include <QtCore/QMetaObject>
+#include <QtCore/QMetaType>
+#include <QtCore/QVector>
+#include <QtQml/QJSValue>
+
+#include "Bench.h"
+#include "hsqml.h"
+#include "Engine.h"
+#include "Manager.h"
+#include "Object.h"
+
+// Objects created and finalised per churn measurement
+static const int cObjects = 1 << 16;
+
+// Objects marshalled to JavaScript per churn measurement
+static const int cQObjects = 1 << 12;
+
+// Calls made per measurement of a single entry point
+static const int cCalls = 1 << 20;
+
+// Elements accessed per array measurement
+static const int cElements = 1 << 18;
+
+typedef HsStablePtr (*BenchStableFn)();
+
+static int gBenchValue = 0;
+
+// Stub uniform functions which do as little as possible, so that only the
+// cost of dispatching to them is measured.
+static void bench_signal(void*, void**)
+{}
+
+static void bench_ping(void*, void**)
+{
+    gBenchValue++;
+}
+
+static void bench_read_value(void*, void** a)
+{
+    *reinterpret_cast<int*>(a[0]) = gBenchValue;
+}
+
+static void bench_write_value(void*, void** a)
+{
+    gBenchValue = *reinterpret_cast<int*>(a[0]);
+}
+
+// Builds a class laid out as by compileClass with a signal 'pinged', a method
+// 'ping' and a property 'value' which notifies with 'pinged'. It is never
+// released because the functions are not Haskell function pointers.
+static HsQMLClassHandle* create_bench_class()
+{
+    static const unsigned int cMetaData[] = {
+        // Header
+        7, 0, 0, 0, 2, 15, 1, 25, 0, 0, 0, 0, 0, 1,
+        // Parameters
+        QMetaType::Void,
+        // Methods
+        1, 0, 14, 2, 0x46,
+        3, 0, 14, 2, 0x42,
+        // Properties
+        4, QMetaType::Int, 0x00404003,
+        0,
+        0
+    };
+    static const unsigned int cMetaStrInfo[] = {5, 9, 16, 17, 22, 28};
+    static const char cMetaStrChar[] = "BenchFFI\0pinged\0\0ping\0value";
+    static HsQMLUniformFunc cMethods[] = {&bench_signal, &bench_ping};
+    static HsQMLUniformFunc cProperties[] = {
+        &bench_read_value, &bench_write_value};
+
+    // The class takes ownership of the meta-data and frees the strings
+    unsigned int* metaData =
+        static_cast<unsigned int*>(std::malloc(sizeof(cMetaData)));
+    std::memcpy(metaData, cMetaData, sizeof(cMetaData));
+    unsigned int* metaStrInfo =
+        static_cast<unsigned int*>(std::malloc(sizeof(cMetaStrInfo)));
+    std::memcpy(metaStrInfo, cMetaStrInfo, sizeof(cMetaStrInfo));
+    char* metaStrChar = static_cast<char*>(std::malloc(sizeof(cMetaStrChar)));
+    std::memcpy(metaStrChar, cMetaStrChar, sizeof(cMetaStrChar));
+    return hsqml_create_class(
+        metaData, metaStrInfo, metaStrChar, NULL, cMethods, cProperties);
+}
+
+static void benchObjectChurn(HsQMLClassHandle* klass, BenchStableFn newStable)
+{
+    // Stable pointers are made beforehand so that only the object is timed
+    QVector<HsStablePtr> ptrs(cObjects);
+    for (int i=0; i<cObjects; i++) {
+        ptrs[i] = newStable();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cObjects; i++) {
+        HsQMLObjectHandle* hndl = hsqml_create_object(ptrs[i], klass);
+        hsqml_finalise_object_handle(hndl);
+    }
+    hsqmlBenchReport("ffi/object/churn", 1, timer.nsecsElapsed(), cObjects);
+
+    for (int i=0; i<cQObjects; i++) {
+        ptrs[i] = newStable();
+    }
+    timer.start();
+    for (int i=0; i<cQObjects; i++) {
+        HsQMLObjectHandle* hndl = hsqml_create_object(ptrs[i], klass);
+        gBenchSink = gBenchSink +
+            reinterpret_cast<quintptr>(hsqml_object_get_jval(hndl));
+        hsqml_finalise_object_handle(hndl);
+    }
+    hsqmlBenchReport(
+        "ffi/object/churn/marshalled", 1, timer.nsecsElapsed(), cQObjects);
+    gManager->activeEngine()->declEngine()->collectGarbage();
+}
+
+static void benchGetJVal(HsQMLObjectHandle* hndl)
+{
+    QElapsedTimer timer;
+    quintptr sum = 0;
+    timer.start();
+    for (int i=0; i<cCalls; i++) {
+        sum += reinterpret_cast<quintptr>(hsqml_object_get_jval(hndl));
+    }
+    gBenchSink = gBenchSink + sum;
+    hsqmlBenchReport("ffi/object/get_jval", 1, timer.nsecsElapsed(), cCalls);
+}
+
+static void benchGCLock(HsQMLClassHandle* klass, BenchStableFn newStable)
+{
+    HsQMLEngine* engine = gManager->activeEngine();
+    HsQMLObjectHandle* hndl = hsqml_create_object(newStable(), klass);
+    HsQMLObjectProxy* proxy = reinterpret_cast<HsQMLObjectProxy*>(hndl);
+    proxy->object(engine);
+
+    // Variant references are strong and release the lock synchronously,
+    // unlike handles whose release is queued for the event loop.
+    proxy->ref(HsQMLObjectProxy::Variant);
+    hsqml_finalise_object_handle(hndl);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cCalls; i++) {
+        proxy->deref(HsQMLObjectProxy::Variant);
+        proxy->ref(HsQMLObjectProxy::Variant);
+        proxy->tryGCLock();
+    }
+    hsqmlBenchReport("ffi/gclock/cycle", 1, timer.nsecsElapsed(), cCalls);
+
+    // The wrapper is released on every cycle as if it were never reused
+    timer.start();
+    for (int i=0; i<cQObjects; i++) {
+        proxy->deref(HsQMLObjectProxy::Variant);
+        engine->releaseGCLocks();
+        proxy->ref(HsQMLObjectProxy::Variant);
+        proxy->tryGCLock();
+    }
+    hsqmlBenchReport(
+        "ffi/gclock/cycle/released", 1, timer.nsecsElapsed(), cQObjects);
+    proxy->deref(HsQMLObjectProxy::Variant);
+    engine->releaseGCLocks();
+
+    // Objects are deleted while their release is pending, as when destroy()
+    // is called on them from QML, and must be dropped from the engine's set.
+    QVector<HsStablePtr> ptrs(cQObjects);
+    for (int i=0; i<cQObjects; i++) {
+        ptrs[i] = newStable();
+    }
+    timer.start();
+    for (int i=0; i<cQObjects; i++) {
+        HsQMLObjectHandle* hndl = hsqml_create_object(ptrs[i], klass);
+        HsQMLObjectProxy* objProxy =
+            reinterpret_cast<HsQMLObjectProxy*>(hndl);
+        HsQMLObject* obj = objProxy->object(engine);
+        objProxy->ref(HsQMLObjectProxy::Variant);
+        hsqml_finalise_object_handle(hndl);
+        objProxy->deref(HsQMLObjectProxy::Variant);
+        delete obj;
+    }
+    engine->releaseGCLocks();
+    hsqmlBenchReport(
+        "ffi/gclock/cycle/deleted", 1, timer.nsecsElapsed(), cQObjects);
+}
+
+static void benchStrings(int length)
+{
+    // Strings are marshalled by copying into and out of the handle's buffer
+    QVector<UTF16> src(length, 'x');
+    QVector<UTF16> dst(length);
+    char* hndl = new char[hsqml_get_string_size()];
+    int count = cCalls/qMax(length/16, 1);
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<count; i++) {
+        hsqml_init_string(hndl);
+        UTF16* buf = hsqml_write_string(length, hndl);
+        std::memcpy(buf, src.constData(), length*sizeof(UTF16));
+        hsqml_deinit_string(hndl);
+    }
+    hsqmlBenchReport("ffi/string/write", length, timer.nsecsElapsed(), count);
+
+    hsqml_init_string(hndl);
+    std::memcpy(hsqml_write_string(length, hndl),
+        src.constData(), length*sizeof(UTF16));
+    timer.start();
+    for (int i=0; i<count; i++) {
+        UTF16* buf;
+        int len = hsqml_read_string(hndl, &buf);
+        std::memcpy(dst.data(), buf, len*sizeof(UTF16));
+    }
+    hsqmlBenchReport("ffi/string/read", length, timer.nsecsElapsed(), count);
+    hsqml_deinit_string(hndl);
+    gBenchSink = gBenchSink + dst[0];
+    delete[] hndl;
+}
+
+static void benchArrays(unsigned int length)
+{
+    size_t jvalSize = hsqml_get_jval_size();
+    char* array = new char[jvalSize];
+    char* value = new char[jvalSize];
+    hsqml_init_jval_array(array, length);
+    hsqml_init_jval_int(value, 42);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cElements; i++) {
+        hsqml_jval_array_set(array, i % length, value);
+    }
+    hsqmlBenchReport(
+        "ffi/jval/array_set", length, timer.nsecsElapsed(), cElements);
+
+    quintptr sum = 0;
+    timer.start();
+    for (int i=0; i<cElements; i++) {
+        hsqml_jval_array_get(array, i % length, value);
+        sum += hsqml_get_jval_int(value);
+    }
+    hsqmlBenchReport(
+        "ffi/jval/array_get", length, timer.nsecsElapsed(), cElements);
+    gBenchSink = gBenchSink + sum;
+
+    hsqml_deinit_jval(value);
+    hsqml_deinit_jval(array);
+    delete[] value;
+    delete[] array;
+}
+
+static void benchFireSignal(const char* name, HsQMLObjectHandle* hndl)
+{
+    // Firing clears the active engine, which the caller then restores in the
+    // same way as Haskell does.
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cCalls; i++) {
+        hsqml_fire_signal(hndl, 0, NULL);
+        hsqml_object_set_active(hndl);
+    }
+    hsqmlBenchReport(name, 1, timer.nsecsElapsed(), cCalls);
+}
+
+static void benchMetaCall(
+    const char* name, QObject* obj, QMetaObject::Call c, int idx, void** a)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cCalls; i++) {
+        QMetaObject::metacall(obj, c, idx, a);
+    }
+    hsqmlBenchReport(name, 1, timer.nsecsElapsed(), cCalls);
+}
+
+// Runs inside a method called from QML, so the caller is the event loop
+// thread and the active engine is set.
+extern "C" void hsqml_bench_ffi(BenchStableFn newStable)
+{
+    HsQMLEngine* engine = gManager->activeEngine();
+    Q_ASSERT(engine);
+    HsQMLClassHandle* klass = create_bench_class();
+
+    benchObjectChurn(klass, newStable);
+
+    HsQMLObjectHandle* hndl = hsqml_create_object(newStable(), klass);
+    benchGetJVal(hndl);
+    benchGCLock(klass, newStable);
+
+    for (int n=4; n<=1024; n*=16) {
+        benchStrings(n);
+    }
+    for (unsigned int n=16; n<=4096; n*=16) {
+        benchArrays(n);
+    }
+
+    HsQMLObjectProxy* proxy = reinterpret_cast<HsQMLObjectProxy*>(hndl);
+    HsQMLObject* obj = proxy->object(engine);
+    const QMetaObject* mo = obj->metaObject();
+    int signalIdx = mo->methodOffset();
+    int pingIdx = mo->methodOffset()+1;
+    int valueIdx = mo->propertyOffset();
+
+    hsqmlBenchVariantHook(obj);
+
+    benchFireSignal("ffi/signal/fire", hndl);
+    QMetaObject::Connection conn = QObject::connect(
+        obj, mo->method(signalIdx), obj, mo->method(pingIdx),
+        Qt::DirectConnection);
+    benchFireSignal("ffi/signal/fire/connected", hndl);
+    QObject::disconnect(conn);
+
+    // Metacalls set the active engine themselves and so must not be nested
+    gManager->setActiveEngine(NULL);
+    int value = 0;
+    void* args[] = {&value};
+    benchMetaCall("ffi/metacall/method",
+        obj, QMetaObject::InvokeMetaMethod, pingIdx, args);
+    benchMetaCall("ffi/metacall/read",
+        obj, QMetaObject::ReadProperty, valueIdx, args);
+    benchMetaCall("ffi/metacall/write",
+        obj, QMetaObject::WriteProperty, valueIdx, args);
+    gManager->setActiveEngine(engine);
+
+    gBenchSink = gBenchSink + gBenchValue;
+    hsqml_finalise_object_handle(hndl);
+}
@@ -0,0 +1,82 @@
+#include <QtCore/QSet>
+
+#include "Bench.h"
+#include "ObjectSet.h"
+
+// Lookups made per measurement, regardless of the registry size
+static const int cLookups = 1 << 22;
+
+// Size of each fake object, roughly that of a small QObject subclass
+static const int cObjectStride = 48;
+
+template <typename S>
+static void benchLookups(
+    const char* name, const S& set, const QVector<const QObject*>& probes)
+{
+    QElapsedTimer timer;
+    quintptr hits = 0;
+    int count = probes.size();
+    timer.start();
+    for (int n=0, i=0; n<cLookups; n++) {
+        hits += set.contains(probes[i]);
+        if (++i == count) {
+            i = 0;
+        }
+    }
+    gBenchSink = gBenchSink + hits;
+    hsqmlBenchReport(name, probes.size()/2, timer.nsecsElapsed(), cLookups);
+}
+
+extern "C" void hsqml_bench_object_set(int size)
+{
+    // Every other object is registered, so the probes hit half the time as
+    // with QVariants which do and do not hold HsQML objects.
+    char* mem = new char[2*static_cast<size_t>(size)*cObjectStride];
+    QVector<const QObject*> members;
+    QVector<const QObject*> probes;
+    members.reserve(size);
+    probes.reserve(2*size);
+    QVector<int> perm = hsqmlBenchShuffle(2*size);
+    for (int i=0; i<2*size; i++) {
+        const QObject* obj = reinterpret_cast<const QObject*>(
+            mem + static_cast<size_t>(perm[i])*cObjectStride);
+        if (i & 1) {
+            members.append(obj);
+        }
+        probes.append(obj);
+    }
+
+    QElapsedTimer timer;
+
+    QSet<const QObject*> qset;
+    timer.start();
+    for (int i=0; i<size; i++) {
+        qset.insert(members[i]);
+    }
+    hsqmlBenchReport("registry/insert/QSet", size, timer.nsecsElapsed(), size);
+    benchLookups("registry/lookup/QSet", qset, probes);
+
+    HsQMLObjectSet oset;
+    timer.start();
+    for (int i=0; i<size; i++) {
+        oset.insert(members[i]);
+    }
+    hsqmlBenchReport("registry/insert/HsQMLObjectSet", size,
+        timer.nsecsElapsed(), size);
+    benchLookups("registry/lookup/HsQMLObjectSet", oset, probes);
+
+    timer.start();
+    for (int i=0; i<size; i++) {
+        qset.remove(members[i]);
+    }
+    hsqmlBenchReport("registry/remove/QSet", size, timer.nsecsElapsed(), size);
+
+    timer.start();
+    for (int i=0; i<size; i++) {
+        oset.remove(members[i]);
+    }
+    hsqmlBenchReport("registry/remove/HsQMLObjectSet", size,
+        timer.nsecsElapsed(), size);
+
+    delete[] mem;
+}
@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <QtCore/QVector>
+
+#include "Bench.h"
+#include "Pool.h"
+
+// Blocks allocated and freed per measurement
+static const int cBlocks = 1 << 20;
+
+// Size of a proxy on 64-bit platforms, which is the smaller of the two
+static const size_t cBlockSize = 40;
+
+struct BenchMalloc
+{
+    void* alloc() { return std::malloc(cBlockSize); }
+    void free(void* ptr) { std::free(ptr); }
+};
+
+struct BenchPool
+{
+    BenchPool(HsQMLPool* pool) : mPool(pool) {}
+    void* alloc() { return mPool->alloc(); }
+    void free(void* ptr) { mPool->free(ptr); }
+    HsQMLPool* mPool;
+};
+
+// Keeps a set of live blocks and replaces them in a random order, as model
+// updates do when rows are replaced.
+template <typename T>
+static void benchChurn(const char* name, T alloc, int live)
+{
+    QVector<void*> blocks(live);
+    for (int i=0; i<live; i++) {
+        blocks[i] = alloc.alloc();
+    }
+    QVector<int> order = hsqmlBenchShuffle(live);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cBlocks; i++) {
+        int j = order[i % live];
+        alloc.free(blocks[j]);
+        blocks[j] = alloc.alloc();
+        *static_cast<char*>(blocks[j]) = 1;
+    }
+    hsqmlBenchReport(name, live, timer.nsecsElapsed(), cBlocks);
+
+    for (int i=0; i<live; i++) {
+        alloc.free(blocks[i]);
+    }
+}
+
+extern "C" void hsqml_bench_pool()
+{
+    static HsQMLPool pool(cBlockSize, Q_ALIGNOF(void*));
+    for (int n=1; n<=65536; n*=16) {
+        benchChurn("pool/churn/malloc", BenchMalloc(), n);
+        benchChurn("pool/churn/pool", BenchPool(&pool), n);
+    }
+}
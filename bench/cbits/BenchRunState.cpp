@@ -0,0 +1,122 @@
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include "Bench.h"
+#include "hsqml.h"
+
+// Notifications made by each thread per measurement
+static const int cNotifies = 1 << 16;
+
+// Largest number of posting threads measured
+static const int cMaxThreads = 64;
+
+// The previous scheme, a reference count guarded by the manager's lock
+class BenchLockedRunState
+{
+public:
+    BenchLockedRunState()
+        : mLock(QMutex::Recursive)
+        , mRunCount(1)
+    {}
+
+    bool acquire()
+    {
+        QMutexLocker locker(&mLock);
+        if (mRunCount > 0) {
+            mRunCount++;
+            return true;
+        }
+        return false;
+    }
+
+    void release()
+    {
+        QMutexLocker locker(&mLock);
+        mRunCount--;
+    }
+
+private:
+    QMutex mLock;
+    int mRunCount;
+};
+
+// The manager's own run state, see HsQMLManager::acquireRun(). The event
+// loop must be running so that references can be taken.
+class BenchManagerRunState
+{
+public:
+    bool acquire()
+    {
+        return hsqml_evloop_require() == HSQML_EVLOOP_OK;
+    }
+
+    void release()
+    {
+        hsqml_evloop_release();
+    }
+};
+
+// Each thread makes the run state calls which wakeJobs() makes whenever it
+// raises a lane's wakeup flag, which is the worst case for contention.
+template <typename T>
+class BenchNotifyThread : public QThread
+{
+public:
+    BenchNotifyThread(T* state, QAtomicInt* go)
+        : mState(state)
+        , mGo(go)
+    {}
+
+    void run()
+    {
+        while (!mGo->loadAcquire()) {
+            QThread::yieldCurrentThread();
+        }
+        quintptr posted = 0;
+        for (int i=0; i<cNotifies; i++) {
+            if (mState->acquire()) {
+                posted++;
+                mState->release();
+            }
+        }
+        gBenchSink = gBenchSink + posted;
+    }
+
+private:
+    T* mState;
+    QAtomicInt* mGo;
+};
+
+template <typename T>
+static void benchNotify(const char* name, int threads)
+{
+    T state;
+    QAtomicInt go(0);
+    QVector<BenchNotifyThread<T>*> ts;
+    for (int i=0; i<threads; i++) {
+        ts.append(new BenchNotifyThread<T>(&state, &go));
+        ts.last()->start();
+    }
+
+    // Wall time for all the threads to finish, so flat is perfect scaling
+    QElapsedTimer timer;
+    timer.start();
+    go.storeRelease(1);
+    for (int i=0; i<threads; i++) {
+        ts[i]->wait();
+    }
+    hsqmlBenchReport(name, threads, timer.nsecsElapsed(), cNotifies);
+    qDeleteAll(ts);
+}
+
+// Runs inside a method called from QML, so the event loop is running.
+extern "C" void hsqml_bench_run_state()
+{
+    for (int n=1; n<=cMaxThreads; n*=2) {
+        benchNotify<BenchLockedRunState>("runstate/notify/locked", n);
+        benchNotify<BenchManagerRunState>("runstate/notify/manager", n);
+    }
+}
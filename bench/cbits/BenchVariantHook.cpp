@@ -0,0 +1,68 @@
+#include <QtCore/QObject>
+#include <QtCore/QVariant>
+
+#include "Bench.h"
+#include "Manager.h"
+
+// Declarations for part of Qt's internal API
+Q_DECL_IMPORT const QVariant::Handler* qcoreVariantHandler();
+
+// Variants constructed and cleared per measurement
+static const int cVariants = 1 << 20;
+
+typedef void (*ConstructFn)(QVariant::Private*, const void*);
+typedef void (*ClearFn)(QVariant::Private*);
+
+// The same calls which Qt makes through the handler installed by the manager
+static void manager_construct(QVariant::Private* p, const void* copy)
+{
+    gManager->hookedConstruct(p, copy);
+}
+
+static void manager_clear(QVariant::Private* p)
+{
+    gManager->hookedClear(p);
+}
+
+// Constructs and clears variants on the heap through the given functions, as
+// QVariant does when it calls the registered handler.
+static void benchHandler(const char* name, ConstructFn construct,
+    ClearFn clear, int type, const void* value)
+{
+    ConstructFn volatile constructFn = construct;
+    ClearFn volatile clearFn = clear;
+    QVariant::Private* vars = new QVariant::Private[cVariants];
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<cVariants; i++) {
+        vars[i].type = type;
+        vars[i].is_null = false;
+        constructFn(&vars[i], value);
+    }
+    for (int i=0; i<cVariants; i++) {
+        clearFn(&vars[i]);
+    }
+    hsqmlBenchReport(name, 1, timer.nsecsElapsed(), cVariants);
+    delete[] vars;
+}
+
+// Compares Qt's own handler with the manager's hooks, which count references
+// to the object if it belongs to HsQML. Must be called on the event thread.
+void hsqmlBenchVariantHook(QObject* hsObj)
+{
+    const QVariant::Handler* original = qcoreVariantHandler();
+    QObject other;
+    QObject* otherObj = &other;
+    int value = 42;
+
+    benchHandler("variant/original/object", original->construct,
+        original->clear, QMetaType::QObjectStar, &hsObj);
+    benchHandler("variant/hooked/object", &manager_construct,
+        &manager_clear, QMetaType::QObjectStar, &hsObj);
+    benchHandler("variant/hooked/foreign", &manager_construct,
+        &manager_clear, QMetaType::QObjectStar, &otherObj);
+    benchHandler("variant/original/int", original->construct,
+        original->clear, QMetaType::Int, &value);
+    benchHandler("variant/hooked/int", &manager_construct,
+        &manager_clear, QMetaType::Int, &value);
+}
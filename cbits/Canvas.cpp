@@ -58,6 +58,8 @@ HsQMLGLDelegate::CallbacksRef HsQMLGLDelegate::makeCallbacks()
         HsQMLGLCleanupCb cleanupCb;
         HsQMLGLSyncCb syncCb;
         HsQMLGLPaintCb paintCb;
+        HsQMLStallScope stall(
+            gManager->stallProfiler(), HSQML_STALL_CANVAS_DELEGATE);
         mImpl->mMakeCallbacksCb(&setupCb, &cleanupCb, &syncCb, &paintCb);
         dataPtr = new HsQMLGLCallbacks(setupCb, cleanupCb, syncCb, paintCb);
     }
@@ -202,6 +204,8 @@ void HsQMLCanvasBackEnd::setStatus(HsQMLCanvas::Status status)
 
 void HsQMLCanvasBackEnd::doRendering()
 {
+    HsQMLTraceSpan span(gManager->tracer(), "canvas", "render");
+
     if (!mGL) {
         mGL = mWindow->openglContext();
         QObject::connect(
@@ -223,6 +227,8 @@ void HsQMLCanvasBackEnd::doRendering()
             setStatus(HsQMLCanvas::BadProcs);
             return;
         }
+        HsQMLStallScope stall(
+            gManager->stallProfiler(), HSQML_STALL_CANVAS_SETUP);
         mGLCallbacks->mSetupCb(
             ctype, format.majorVersion(), format.minorVersion());
     }
@@ -276,7 +282,11 @@ void HsQMLCanvasBackEnd::doRendering()
     }
 
     setStatus(HsQMLCanvas::Okay);
-    mGLCallbacks->mPaintCb(matrix.data(), mItemWidth, mItemHeight);
+    {
+        HsQMLStallScope stall(
+            gManager->stallProfiler(), HSQML_STALL_CANVAS_PAINT);
+        mGLCallbacks->mPaintCb(matrix.data(), mItemWidth, mItemHeight);
+    }
 
     if (inlineMode) {
         mFBO->release();
@@ -297,6 +307,8 @@ void HsQMLCanvasBackEnd::doCleanup()
         mTexture.reset();
         mFBO.reset();
 
+        HsQMLStallScope stall(
+            gManager->stallProfiler(), HSQML_STALL_CANVAS_CLEANUP);
         mGLCallbacks->mCleanupCb();
     }
 }
@@ -366,6 +378,9 @@ QSGNode* HsQMLCanvas::updatePaintNode(
 
     // Process model update
     if (mLoadModel) {
+        HsQMLTraceSpan span(gManager->tracer(), "canvas", "sync");
+        HsQMLStallScope stall(
+            gManager->stallProfiler(), HSQML_STALL_CANVAS_SYNC);
         mValidModel = mGLCallbacks->mSyncCb(
             reinterpret_cast<HsQMLJValHandle*>(&mModel));
         mLoadModel = false;
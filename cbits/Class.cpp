@@ -1,6 +1,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <HsFFI.h>
+#include <QtCore/QHash>
 #include <QtCore/QMetaObject>
 #include <QtCore/QMetaType>
 #include <QtCore/QString>
@@ -10,12 +11,32 @@
 #include "Manager.h"
 
 enum MDFields {
-    MD_METHOD_COUNT   = 4,
-    MD_PROPERTY_COUNT = 6,
+    MD_METHOD_COUNT    = 4,
+    MD_METHOD_INDEX    = 5,
+    MD_PROPERTY_COUNT  = 6,
+    MD_PROPERTY_INDEX  = 7,
+    MD_HEADER_SIZE     = 14,
 };
 
 static const char* cRefSrcNames[] = {"Hndl", "Proxy"};
 
+// Returns the number of words in meta-data laid out as by compileClass. The
+// parameters come first, then the methods, the properties and their notify
+// signals, and finally a terminating zero.
+static int metadata_size(const unsigned int* metaData)
+{
+    unsigned int size = MD_HEADER_SIZE;
+    if (metaData[MD_METHOD_COUNT]) {
+        size = qMax(size,
+            metaData[MD_METHOD_INDEX] + 5*metaData[MD_METHOD_COUNT]);
+    }
+    if (metaData[MD_PROPERTY_COUNT]) {
+        size = qMax(size,
+            metaData[MD_PROPERTY_INDEX] + 4*metaData[MD_PROPERTY_COUNT]);
+    }
+    return size+1;
+}
+
 HsQMLClass::HsQMLClass(
     unsigned int*  metaData,
     unsigned int*  metaStrInfo,
@@ -25,6 +46,10 @@ HsQMLClass::HsQMLClass(
     HsQMLUniformFunc* properties)
     : mRefCount(0)
     , mMetaData(metaData)
+    , mMetaSize(metadata_size(metaData))
+    , mStrCount(metaStrInfo[0])
+    , mStrLength(metaStrInfo[mStrCount])
+    , mHash(structureHash(metaData, metaStrInfo, metaStrChar))
     , mHsTypeRep(hsTypeRep)
     , mMethodCount(metaData[MD_METHOD_COUNT])
     , mPropertyCount(metaData[MD_PROPERTY_COUNT])
@@ -32,8 +57,8 @@ HsQMLClass::HsQMLClass(
     , mProperties(properties)
 {
     // Create string data
-    unsigned int strCount = metaStrInfo[0];
-    unsigned int strLength = metaStrInfo[strCount];
+    unsigned int strCount = mStrCount;
+    unsigned int strLength = mStrLength;
     size_t arrayOff = strCount*sizeof(QByteArrayData);
     size_t arraySize = arrayOff+strLength;
     mMetaStrData.reset(new char[arraySize]);
@@ -60,11 +85,15 @@ HsQMLClass::HsQMLClass(
     // Add reference
     ref(Handle);
 
+    gManager->registerClass(this);
     gManager->updateCounter(HsQMLManager::ClassCount, 1);
 }
 
 HsQMLClass::~HsQMLClass()
-{}
+{
+    delete[] mStats.load();
+    std::free(mMetaData);
+}
 
 const char* HsQMLClass::name()
 {
@@ -105,26 +134,86 @@ void HsQMLClass::ref(RefSrc src)
 {
     int count = mRefCount.fetchAndAddOrdered(1);
 
-    HSQML_LOG(count == 0 ? 1 : 2,
-        QString().sprintf("%s Class, name=%s, src=%s, count=%d.",
-        count ? "Ref" : "New", name(), cRefSrcNames[src], count+1));
+    HSQML_LOG_EVENT(count == 0 ? 1 : 2, HsQMLLogRecord::ClassRecord,
+        count ? "Ref" : "New", name(), 0, cRefSrcNames[src], count+1);
 }
 
 void HsQMLClass::deref(RefSrc src)
 {
     int count = mRefCount.fetchAndAddOrdered(-1);
 
-    HSQML_LOG(count == 1 ? 1 : 2,
-        QString().sprintf("%s Class, name=%s, src=%s, count=%d.",
-        count > 1 ? "Deref" : "Delete", name(), cRefSrcNames[src], count));
+    HSQML_LOG_EVENT(count == 1 ? 1 : 2, HsQMLLogRecord::ClassRecord,
+        count > 1 ? "Deref" : "Delete", name(), 0, cRefSrcNames[src], count);
 
     if (count == 1) {
         destroy();
     }
 }
 
+void HsQMLClass::recordMetaCall(QMetaObject::Call c, int id, qint64 nsecs)
+{
+    MemberStats* stats = mStats.loadAcquire();
+    if (!stats) {
+        stats = new MemberStats[mMethodCount + 2*mPropertyCount];
+        if (!mStats.testAndSetOrdered(NULL, stats)) {
+            delete[] stats;
+            stats = mStats.loadAcquire();
+        }
+    }
+
+    // Methods come first, followed by the read and write of each property
+    MemberStats& member = stats[QMetaObject::InvokeMetaMethod == c ?
+        id : mMethodCount + 2*id + (QMetaObject::WriteProperty == c)];
+
+    // Bucket i holds calls which took between 2^i and 2^(i+1) nanoseconds
+    int bucket = 0;
+    while ((nsecs >>= 1) > 0 && bucket < MetaCallBuckets-1) {
+        bucket++;
+    }
+    member.mCount.fetchAndAddRelaxed(1);
+    member.mBuckets[bucket].fetchAndAddRelaxed(1);
+}
+
+void HsQMLClass::collectMetaCalls(QVector<MetaCallRecord>& records)
+{
+    MemberStats* stats = mStats.loadAcquire();
+    if (!stats) {
+        return;
+    }
+
+    for (int i=0; i<mMethodCount + 2*mPropertyCount; i++) {
+        int count = stats[i].mCount.load();
+        if (count == 0) {
+            continue;
+        }
+
+        MetaCallRecord rec;
+        rec.mClass = name();
+        if (i < mMethodCount) {
+            rec.mMember = mMetaObject.method(
+                mMetaObject.methodOffset()+i).name();
+            rec.mKind = HSQML_METACALL_METHOD;
+        }
+        else {
+            int id = (i-mMethodCount)/2;
+            rec.mMember = mMetaObject.property(
+                mMetaObject.propertyOffset()+id).name();
+            rec.mKind = (i-mMethodCount) & 1 ?
+                HSQML_METACALL_WRITE : HSQML_METACALL_READ;
+        }
+        rec.mCount = count;
+        for (int j=0; j<MetaCallBuckets; j++) {
+            rec.mBuckets[j] = stats[i].mBuckets[j].load();
+        }
+        records.append(rec);
+    }
+}
+
 void HsQMLClass::destroy()
 {
+    // The meta-object's data is freed below, so stop reporting on it first
+    gManager->unregisterClass(this);
+
     for (int i=0; i<mMethodCount; i++) {
         gManager->freeFun((HsFunPtr)mMethods[i]);
         mMethods[i] = NULL;
@@ -137,8 +226,7 @@ void HsQMLClass::destroy()
     }
     gManager->freeStable(mHsTypeRep);
     mHsTypeRep = NULL;
-    std::free(mMetaData);
-    mMetaData = NULL;
+    delete[] mStats.fetchAndStoreOrdered(NULL);
     std::free(mMethods);
     mMethods = NULL;
     std::free(mProperties);
@@ -148,10 +236,79 @@ void HsQMLClass::destroy()
 
     // Qt internally retains pointers to QMetaObjects it has encountered
     // without any mechanism for unregistering them. Hence, classes can't be
-    // deleted prior to shutdown.
+    // deleted prior to shutdown. The meta-data is kept so that the class can
+    // be revived by a new class with the same structure.
     gManager->zombifyClass(this);
 }
 
+void HsQMLClass::revive(
+    unsigned int*  metaData,
+    HsStablePtr    hsTypeRep,
+    HsQMLUniformFunc* methods,
+    HsQMLUniformFunc* properties)
+{
+    Q_ASSERT(mRefCount.load() == 0);
+
+    // The meta-object is left as it was, including the class name
+    std::free(metaData);
+    mHsTypeRep = hsTypeRep;
+    mMethods = methods;
+    mProperties = properties;
+
+    ref(Handle);
+
+    gManager->registerClass(this);
+    gManager->updateCounter(HsQMLManager::ClassCount, 1);
+}
+
+uint HsQMLClass::structureHash(
+    const unsigned int*  metaData,
+    const unsigned int*  metaStrInfo,
+    const char*          metaStrChar)
+{
+    // The class name is the first string and is left out because it has a
+    // serial number appended, hence it differs even for identical classes.
+    unsigned int nameEnd = metaStrInfo[1];
+    unsigned int strLength = metaStrInfo[metaStrInfo[0]];
+    uint hash = qHash(QByteArray::fromRawData(
+        reinterpret_cast<const char*>(metaData),
+        metadata_size(metaData)*sizeof(unsigned int)));
+    return qHash(QByteArray::fromRawData(
+        metaStrChar+nameEnd, strLength-nameEnd), hash);
+}
+
+bool HsQMLClass::hasStructure(
+    const unsigned int*  metaData,
+    const unsigned int*  metaStrInfo,
+    const char*          metaStrChar)
+{
+    int size = metadata_size(metaData);
+    if (size != mMetaSize ||
+        std::memcmp(metaData, mMetaData, size*sizeof(unsigned int))) {
+        return false;
+    }
+
+    unsigned int nameEnd = metaStrInfo[1];
+    unsigned int strLength = metaStrInfo[metaStrInfo[0]];
+    unsigned int oldNameEnd = std::strlen(name())+1;
+    const char* oldChars = &mMetaStrData[mStrCount*sizeof(QByteArrayData)];
+    return metaStrInfo[0] == mStrCount &&
+        strLength-nameEnd == mStrLength-oldNameEnd &&
+        !std::memcmp(metaStrChar+nameEnd, oldChars+oldNameEnd,
+            strLength-nameEnd);
+}
+
+uint HsQMLClass::structHash() const
+{
+    return mHash;
+}
+
+int HsQMLClass::pinnedSize() const
+{
+    return sizeof(HsQMLClass) + mMetaSize*sizeof(unsigned int) +
+        mStrCount*sizeof(QByteArrayData) + mStrLength;
+}
+
 extern "C" int hsqml_get_next_class_id()
 {
     return gManager->updateCounter(HsQMLManager::ClassSerial, 1);
@@ -165,8 +322,21 @@ extern "C" HsQMLClassHandle* hsqml_create_class(
     HsQMLUniformFunc* methods,
     HsQMLUniformFunc* properties)
 {
-    HsQMLClass* klass = new HsQMLClass(
-        metaData, metaStrInfo, metaStrChar, hsTypeRep, methods, properties);
+    // Reuse the meta-object of a dead class with the same structure if there
+    // is one, otherwise Qt would pin another copy of it.
+    HsQMLClass* klass =
+        gManager->reviveClass(metaData, metaStrInfo, metaStrChar);
+    if (klass) {
+        klass->revive(metaData, hsTypeRep, methods, properties);
+    }
+    else {
+        klass = new HsQMLClass(
+            metaData, metaStrInfo, metaStrChar, hsTypeRep, methods, properties);
+    }
+
+    // The strings have been copied into the class
+    std::free(metaStrInfo);
+    std::free(metaStrChar);
     return (HsQMLClassHandle*)klass;
 }
 
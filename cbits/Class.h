@@ -3,6 +3,9 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
 #include <QtCore/QScopedArrayPointer>
 
 #include "hsqml.h"
@@ -22,20 +25,47 @@ public:
     const HsQMLUniformFunc* properties();
     const QMetaObject* metaObj();
     void destroy();
+    void revive(
+        unsigned int*, HsStablePtr, HsQMLUniformFunc*, HsQMLUniformFunc*);
+    static uint structureHash(
+        const unsigned int*, const unsigned int*, const char*);
+    bool hasStructure(const unsigned int*, const unsigned int*, const char*);
+    uint structHash() const;
+    int pinnedSize() const;
     enum RefSrc {Handle, ObjProxy};
     void ref(RefSrc);
     void deref(RefSrc);
 
+    enum {MetaCallBuckets = 32};
+    struct MemberStats {
+        QAtomicInt mCount;
+        QAtomicInt mBuckets[MetaCallBuckets];
+    };
+    struct MetaCallRecord {
+        QByteArray mClass;
+        QByteArray mMember;
+        HsQMLMetaCallKind mKind;
+        int mCount;
+        int mBuckets[MetaCallBuckets];
+    };
+    void recordMetaCall(QMetaObject::Call, int, qint64);
+    void collectMetaCalls(QVector<MetaCallRecord>&);
+
 private:
     QAtomicInt mRefCount;
     unsigned int* mMetaData;
+    int mMetaSize;
     QScopedArrayPointer<char> mMetaStrData;
+    unsigned int mStrCount;
+    unsigned int mStrLength;
+    uint mHash;
     HsStablePtr mHsTypeRep;
     int mMethodCount;
     int mPropertyCount;
     HsQMLUniformFunc* mMethods;
     HsQMLUniformFunc* mProperties;
     QMetaObject mMetaObject;
+    QAtomicPointer<MemberStats> mStats;
 };
 
 #endif /*HSQML_CLASS_H*/
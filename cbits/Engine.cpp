@@ -9,6 +9,9 @@ static const char* cRefSrcNames[] = {
     "Hndl", "Eng", "Event"
 };
 
+// Milliseconds for which unlocked objects keep their JavaScript wrappers
+static const int cGCUnlockDelay = 1000;
+
 HsQMLEngineProxy::HsQMLEngineProxy()
     : mEngine(NULL)
     , mDead(false)
@@ -50,18 +53,17 @@ void HsQMLEngineProxy::ref(RefSrc src)
 {
     int count = mRefCount.fetchAndAddOrdered(1);
 
-    HSQML_LOG(count == 0 ? 3 : 4,
-        QString().sprintf("%s EngineProxy, id=%d, src=%s, count=%d.",
-        count ? "Ref" : "New", mSerial, cRefSrcNames[src], count+1));
+    HSQML_LOG_EVENT(count == 0 ? 3 : 4, HsQMLLogRecord::EngineRecord,
+        count ? "Ref" : "New", NULL, mSerial, cRefSrcNames[src], count+1);
 }
 
 void HsQMLEngineProxy::deref(RefSrc src)
 {
     int count = mRefCount.fetchAndAddOrdered(-1);
 
-    HSQML_LOG(count == 0 ? 3 : 4,
-        QString().sprintf("%s EngineProxy, id=%d, src=%s, count=%d.",
-        count > 1 ? "Deref" : "Delete", mSerial, cRefSrcNames[src], count));
+    HSQML_LOG_EVENT(count == 0 ? 3 : 4, HsQMLLogRecord::EngineRecord,
+        count > 1 ? "Deref" : "Delete", NULL, mSerial, cRefSrcNames[src],
+        count);
 
     if (count == 1) {
         delete this;
@@ -93,6 +95,11 @@ HsQMLEngine::HsQMLEngine(const HsQMLEngineCreateEvent* config, QObject* parent)
     , mComponent(&mEngine)
     , mStopCb(config->stopCb)
 {
+    HsQMLTraceSpan span(gManager->tracer(), "engine", "createEngine");
+    if (span.isActive()) {
+        span.addArg("url", config->initialURL.toUtf8());
+    }
+
     // Setup life-cycle
     mProxy->setEngine(this);
     mProxy->ref(HsQMLEngineProxy::Engine);
@@ -104,6 +111,11 @@ HsQMLEngine::HsQMLEngine(const HsQMLEngineCreateEvent* config, QObject* parent)
     QObject::connect(
         &mComponent, SIGNAL(statusChanged(QQmlComponent::Status)),
         this, SLOT(componentStatus(QQmlComponent::Status)));
+    QObject::connect(
+        &mGCUnlockTimer, SIGNAL(timeout()),
+        this, SLOT(releaseGCLocks()));
+    mGCUnlockTimer.setSingleShot(true);
+    mGCUnlockTimer.setInterval(cGCUnlockDelay);
 
     // Obtain, re-parent, and set QML global object
     if (config->contextObject) {
@@ -120,6 +132,7 @@ HsQMLEngine::HsQMLEngine(const HsQMLEngineCreateEvent* config, QObject* parent)
         QStringList(config->pluginPaths) << mEngine.pluginPathList());
 
     // Load document
+    gManager->markStartup(HSQML_STARTUP_LOAD_STARTED);
     mComponent.loadUrl(QUrl(config->initialURL));
 }
 
@@ -138,6 +151,10 @@ HsQMLEngine::~HsQMLEngine()
 
     // Delete other owned resources
     qDeleteAll(mResources);
+
+    // Objects are deleted along with the QML engine regardless of their
+    // wrappers, so there is nothing left to release.
+    mGCUnlocks.clear();
 }
 
 bool HsQMLEngine::eventFilter(QObject* obj, QEvent* ev)
@@ -153,11 +170,66 @@ QQmlEngine* HsQMLEngine::declEngine()
     return &mEngine;
 }
 
+bool HsQMLEngine::requestFrame()
+{
+    if (mWindow && mWindow->isExposed()) {
+        mWindow->update();
+        return true;
+    }
+    return false;
+}
+
+void HsQMLEngine::releaseGCLockLater(HsQMLObject* obj)
+{
+    mGCUnlocks.insert(obj);
+    if (!mGCUnlockTimer.isActive()) {
+        mGCUnlockTimer.start();
+    }
+}
+
+void HsQMLEngine::cancelGCRelease(HsQMLObject* obj)
+{
+    mGCUnlocks.remove(obj);
+}
+
+void HsQMLEngine::releaseGCLocks()
+{
+    HsQMLTraceSpan span(gManager->tracer(), "gc", "releaseGCLocks");
+    if (span.isActive()) {
+        span.addArg("objects", mGCUnlocks.size());
+    }
+
+    // Objects which have been locked again since keep their wrappers
+    Q_FOREACH(HsQMLObject* obj, mGCUnlocks) {
+        obj->releaseGCLock();
+    }
+    mGCUnlocks.clear();
+    mGCUnlockTimer.stop();
+}
+
+void HsQMLEngine::frameSync()
+{
+    gManager->runFrameJobs();
+}
+
+void HsQMLEngine::frameSwapped()
+{
+    gManager->markStartup(HSQML_STARTUP_FIRST_FRAME);
+    QObject::disconnect(
+        sender(), SIGNAL(frameSwapped()), this, SLOT(frameSwapped()));
+}
+
 void HsQMLEngine::componentStatus(QQmlComponent::Status status)
 {
     switch (status) {
     case QQmlComponent::Ready: {
+        gManager->markStartup(HSQML_STARTUP_COMPONENT_READY);
+        HsQMLTraceSpan span(gManager->tracer(), "engine", "createComponent");
+        if (span.isActive()) {
+            span.addArg("url", mComponent.url().toString().toUtf8());
+        }
         QObject* obj = mComponent.create();
+        gManager->markStartup(HSQML_STARTUP_COMPONENT_CREATED);
         // Freeing the object causes memory corruption prior to Qt 5.2
 #if QT_VERSION >= 0x050200
         mResources << obj;
@@ -184,6 +256,21 @@ void HsQMLEngine::componentStatus(QQmlComponent::Status status)
         if (win) {
             win->installEventFilter(this);
             mEngine.setIncubationController(win->incubationController());
+            mWindow = win;
+            // Emitted on the render thread, so connect directly to avoid
+            // timing the event queue.
+            QObject::connect(
+                win, SIGNAL(frameSwapped()),
+                this, SLOT(frameSwapped()), Qt::DirectConnection);
+#if QT_VERSION >= 0x050300
+            // Emitted on this thread just before the window synchronises
+            // its scene graph with the QML state.
+            if (gManager->getFlag(HSQML_GFLAG_FRAME_SYNC_JOBS)) {
+                QObject::connect(
+                    win, SIGNAL(afterAnimating()),
+                    this, SLOT(frameSync()));
+            }
+#endif
         }
         break;}
     case QQmlComponent::Error: {
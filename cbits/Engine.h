@@ -2,16 +2,21 @@
 #define HSQML_ENGINE_H
 
 #include <QtCore/QEvent>
+#include <QtCore/QPointer>
+#include <QtCore/QSet>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
+#include <QtCore/QTimer>
 #include <QtCore/QUrl>
 #include <QtQml/QQmlEngine>
 #include <QtQml/QQmlContext>
 #include <QtQml/QQmlComponent>
+#include <QtQuick/QQuickWindow>
 
 #include "hsqml.h"
 
 class HsQMLEngine;
+class HsQMLObject;
 class HsQMLObjectProxy;
 class HsQMLWindow;
 
@@ -65,16 +70,26 @@ public:
     ~HsQMLEngine();
     bool eventFilter(QObject*, QEvent*);
     QQmlEngine* declEngine();
+    bool requestFrame();
+    void releaseGCLockLater(HsQMLObject*);
+    void cancelGCRelease(HsQMLObject*);
+    Q_SLOT void releaseGCLocks();
 
 private:
     Q_DISABLE_COPY(HsQMLEngine)
 
     Q_SLOT void componentStatus(QQmlComponent::Status);
+    Q_SLOT void frameSync();
+    Q_SLOT void frameSwapped();
     HsQMLEngineProxy* mProxy;
+    // Declared before the QML engine so that they outlive its objects
+    QSet<HsQMLObject*> mGCUnlocks;
+    QTimer mGCUnlockTimer;
     QQmlEngine mEngine;
     QQmlComponent mComponent;
     QList<HsQMLObjectProxy*> mGlobals;
     QList<QObject*> mResources;
+    QPointer<QQuickWindow> mWindow;
     HsQMLTrivialCb mStopCb;
 };
 
@@ -0,0 +1,133 @@
+#include <QtCore/QMutexLocker>
+
+#include "JobQueue.h"
+
+HsQMLJobQueue::HsQMLJobQueue()
+    : mHead(0)
+    , mTail(0)
+    , mOverflowCount(0)
+    , mSpillPos(0)
+{
+    for (int i=0; i<RingSize; i++) {
+        mRing[i].mSeq.store(i);
+        mRing[i].mJob = NULL;
+    }
+}
+
+HsQMLJobQueue::~HsQMLJobQueue()
+{
+    // Jobs must be taken and released by the owner before destruction
+    Q_ASSERT(mSpillPos == mSpill.size());
+    Q_ASSERT(mOverflow.isEmpty());
+}
+
+void HsQMLJobQueue::push(HsStablePtr job)
+{
+    // Once anything has overflowed, later jobs must follow it in order to
+    // preserve the FIFO ordering of jobs posted from the same thread.
+    if (mOverflowCount.loadAcquire() == 0 && pushRing(job)) {
+        return;
+    }
+
+    QMutexLocker locker(&mOverflowLock);
+    mOverflow.append(job);
+    mOverflowCount.storeRelease(mOverflow.size());
+}
+
+bool HsQMLJobQueue::pop(HsStablePtr* job)
+{
+    // Jobs spilled from the overflow list predate anything in the ring
+    if (mSpillPos < mSpill.size()) {
+        *job = mSpill[mSpillPos++];
+        return true;
+    }
+    if (popRing(job)) {
+        return true;
+    }
+    if (mOverflowCount.loadAcquire() == 0) {
+        return false;
+    }
+
+    // The ring is empty, so take the whole overflow list
+    mSpill.clear();
+    mSpillPos = 0;
+    mOverflowLock.lock();
+    mSpill.swap(mOverflow);
+    mOverflowCount.storeRelease(0);
+    mOverflowLock.unlock();
+    *job = mSpill[mSpillPos++];
+    return true;
+}
+
+int HsQMLJobQueue::takeAll(QVector<HsStablePtr>& jobs)
+{
+    int count = 0;
+    HsStablePtr job;
+    while (pop(&job)) {
+        jobs.append(job);
+        count++;
+    }
+    return count;
+}
+
+int HsQMLJobQueue::take(QVector<HsStablePtr>& jobs, int max)
+{
+    int count = 0;
+    HsStablePtr job;
+    while (count < max && pop(&job)) {
+        jobs.append(job);
+        count++;
+    }
+    return count;
+}
+
+int HsQMLJobQueue::backlog() const
+{
+    // Only exact when called by the consumer with no producers active, but
+    // good enough for reporting.
+    unsigned int head = mHead.load();
+    return static_cast<int>(head - mTail) +
+        mOverflowCount.load() + (mSpill.size() - mSpillPos);
+}
+
+bool HsQMLJobQueue::pushRing(HsStablePtr job)
+{
+    // Bounded multi-producer queue after Dmitry Vyukov. Each cell carries a
+    // sequence number which tells producers and the consumer whose turn it is.
+    unsigned int pos = mHead.load();
+    Cell* cell;
+    for (;;) {
+        cell = &mRing[pos & RingMask];
+        unsigned int seq = cell->mSeq.loadAcquire();
+        int diff = static_cast<int>(seq - pos);
+        if (diff == 0) {
+            if (mHead.testAndSetRelaxed(pos, pos+1)) {
+                break;
+            }
+            pos = mHead.load();
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = mHead.load();
+        }
+    }
+    cell->mJob = job;
+    cell->mSeq.storeRelease(pos+1);
+    return true;
+}
+
+bool HsQMLJobQueue::popRing(HsStablePtr* job)
+{
+    Cell* cell = &mRing[mTail & RingMask];
+    unsigned int seq = cell->mSeq.loadAcquire();
+    if (seq != mTail+1) {
+        return false;
+    }
+    *job = cell->mJob;
+    cell->mJob = NULL;
+    cell->mSeq.storeRelease(mTail+RingSize);
+    mTail++;
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef HSQML_JOBQUEUE_H
+#define HSQML_JOBQUEUE_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+#include "hsqml.h"
+
+class HsQMLJobQueue
+{
+public:
+    HsQMLJobQueue();
+    ~HsQMLJobQueue();
+    void push(HsStablePtr);
+    bool pop(HsStablePtr*);
+    int takeAll(QVector<HsStablePtr>&);
+    int take(QVector<HsStablePtr>&, int);
+    int backlog() const;
+
+private:
+    Q_DISABLE_COPY(HsQMLJobQueue)
+
+    bool pushRing(HsStablePtr);
+    bool popRing(HsStablePtr*);
+
+    enum {RingSize = 4096, RingMask = RingSize-1};
+    struct Cell {
+        QAtomicInt mSeq;
+        HsStablePtr mJob;
+    };
+
+    Cell mRing[RingSize];
+    QAtomicInt mHead;
+    unsigned int mTail;
+    QAtomicInt mOverflowCount;
+    QMutex mOverflowLock;
+    QVector<HsStablePtr> mOverflow;
+    QVector<HsStablePtr> mSpill;
+    int mSpillPos;
+};
+
+#endif /*HSQML_JOBQUEUE_H*/
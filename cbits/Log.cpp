@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <QtCore/QByteArray>
+#include <QtCore/QMutexLocker>
+
+#include "Log.h"
+
+// Maximum time in milliseconds a record waits before being written
+static const unsigned long cWriterInterval = 20;
+
+// Writer which owns the current thread's ring, if any
+struct HsQMLLogRingHandle
+{
+    HsQMLLogRingHandle()
+        : mWriter(NULL)
+        , mRing(NULL)
+    {}
+
+    ~HsQMLLogRingHandle()
+    {
+        // The writer frees the ring once it has been drained
+        if (mRing) {
+            mRing->detach();
+        }
+    }
+
+    HsQMLLogWriter* mWriter;
+    HsQMLLogRing* mRing;
+};
+
+static thread_local HsQMLLogRingHandle gLogRing;
+static HsQMLLogWriter* gLogWriter = NULL;
+
+static void flush_log()
+{
+    if (gLogWriter) {
+        gLogWriter->flush();
+    }
+}
+
+static bool record_before(const HsQMLLogRecord& a, const HsQMLLogRecord& b)
+{
+    return a.mTime < b.mTime;
+}
+
+static void write_record(const HsQMLLogRecord& rec)
+{
+    switch (rec.mKind) {
+    case HsQMLLogRecord::TextRecord:
+        std::fprintf(stderr, "HsQML: %s\n",
+            static_cast<const char*>(rec.mPtr));
+        delete[] static_cast<const char*>(rec.mPtr);
+        break;
+    case HsQMLLogRecord::ClassRecord:
+        std::fprintf(stderr, "HsQML: %s Class, name=%s, src=%s, count=%d.\n",
+            rec.mVerb, rec.name(), rec.mSrc, rec.mCount);
+        break;
+    case HsQMLLogRecord::EngineRecord:
+        std::fprintf(stderr,
+            "HsQML: %s EngineProxy, id=%d, src=%s, count=%d.\n",
+            rec.mVerb, rec.mSerial, rec.mSrc, rec.mCount);
+        break;
+    case HsQMLLogRecord::ObjProxyRecord:
+        std::fprintf(stderr,
+            "HsQML: %s ObjProxy, class=%s, id=%d, src=%s, count=%d.\n",
+            rec.mVerb, rec.name(), rec.mSerial, rec.mSrc, rec.mCount);
+        break;
+    case HsQMLLogRecord::QObjectRecord:
+        std::fprintf(stderr, "HsQML: %s QObject, class=%s, id=%d, qptr=%p.\n",
+            rec.mVerb, rec.name(), rec.mSerial, rec.mPtr);
+        break;
+    }
+    delete[] rec.mLongName;
+}
+
+void HsQMLLogRecord::setName(const char* name)
+{
+    size_t len = name ? std::strlen(name) : 0;
+    if (len < NameSize) {
+        std::memcpy(mName, name ? name : "", len+1);
+        mLongName = NULL;
+    }
+    else {
+        mName[0] = '\0';
+        mLongName = qstrdup(name);
+    }
+}
+
+HsQMLLogRing::HsQMLLogRing()
+    : mHead(0)
+    , mTail(0)
+    , mDetached(0)
+{
+}
+
+bool HsQMLLogRing::push(const HsQMLLogRecord& rec)
+{
+    int head = mHead.load();
+    if (head - mTail.loadAcquire() == RingSize) {
+        return false;
+    }
+    mRecords[head & RingMask] = rec;
+    mHead.storeRelease(head+1);
+    return true;
+}
+
+bool HsQMLLogRing::pop(HsQMLLogRecord* rec)
+{
+    int tail = mTail.load();
+    if (tail == mHead.loadAcquire()) {
+        return false;
+    }
+    *rec = mRecords[tail & RingMask];
+    mTail.storeRelease(tail+1);
+    return true;
+}
+
+int HsQMLLogRing::size() const
+{
+    return mHead.loadAcquire() - mTail.loadAcquire();
+}
+
+void HsQMLLogRing::detach()
+{
+    mDetached.storeRelease(1);
+}
+
+bool HsQMLLogRing::detached() const
+{
+    return mDetached.loadAcquire();
+}
+
+HsQMLLogWriter::HsQMLLogWriter()
+    : mStop(0)
+{
+    mClock.start();
+}
+
+HsQMLLogWriter::~HsQMLLogWriter()
+{
+    if (isRunning()) {
+        mStop.storeRelease(1);
+        mWakeLock.lock();
+        mWake.wakeAll();
+        mWakeLock.unlock();
+        wait();
+    }
+    drain();
+    if (gLogWriter == this) {
+        gLogWriter = NULL;
+    }
+    qDeleteAll(mRings);
+}
+
+void HsQMLLogWriter::write(HsQMLLogRecord& rec)
+{
+    rec.mTime = mClock.nsecsElapsed();
+    HsQMLLogRing* r = ring();
+    if (!r->push(rec)) {
+        // Never drop records, wait for the writer to make space instead. If
+        // it doesn't within an interval then it has stopped, so drain here.
+        QMutexLocker locker(&mWakeLock);
+        while (!r->push(rec)) {
+            mWake.wakeAll();
+            if (!mSpace.wait(&mWakeLock, cWriterInterval)) {
+                locker.unlock();
+                drain();
+                locker.relock();
+            }
+        }
+    }
+    if (r->size() == HsQMLLogRing::RingSize/2) {
+        QMutexLocker locker(&mWakeLock);
+        mWake.wakeAll();
+    }
+}
+
+void HsQMLLogWriter::flush()
+{
+    drain();
+}
+
+void HsQMLLogWriter::run()
+{
+    while (!mStop.loadAcquire()) {
+        mWakeLock.lock();
+        mWake.wait(&mWakeLock, cWriterInterval);
+        mWakeLock.unlock();
+        drain();
+
+        // Let writers blocked on a full ring retry
+        mWakeLock.lock();
+        mSpace.wakeAll();
+        mWakeLock.unlock();
+    }
+}
+
+HsQMLLogRing* HsQMLLogWriter::ring()
+{
+    if (gLogRing.mWriter == this) {
+        return gLogRing.mRing;
+    }
+
+    // Register a new ring for this thread and start writing on first use
+    HsQMLLogRing* r = new HsQMLLogRing();
+    QMutexLocker locker(&mRingsLock);
+    mRings.append(r);
+    if (!isRunning()) {
+        gLogWriter = this;
+        std::atexit(&flush_log);
+        start(QThread::LowestPriority);
+    }
+    if (gLogRing.mRing) {
+        gLogRing.mRing->detach();
+    }
+    gLogRing.mWriter = this;
+    gLogRing.mRing = r;
+    return r;
+}
+
+void HsQMLLogWriter::drain()
+{
+    QMutexLocker drainLocker(&mDrainLock);
+
+    // Collect what is available from every thread and order it by time
+    mRingsLock.lock();
+    for (int i=0; i<mRings.size();) {
+        HsQMLLogRing* r = mRings[i];
+        bool detached = r->detached();
+        HsQMLLogRecord rec;
+        while (r->pop(&rec)) {
+            mBatch.append(rec);
+        }
+        if (detached) {
+            delete r;
+            mRings.remove(i);
+        }
+        else {
+            i++;
+        }
+    }
+    mRingsLock.unlock();
+
+    std::stable_sort(mBatch.begin(), mBatch.end(), &record_before);
+    for (int i=0; i<mBatch.size(); i++) {
+        write_record(mBatch[i]);
+    }
+    if (!mBatch.isEmpty()) {
+        std::fflush(stderr);
+    }
+    mBatch.clear();
+}
@@ -0,0 +1,88 @@
+#ifndef HSQML_LOG_H
+#define HSQML_LOG_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+struct HsQMLLogRecord
+{
+    enum Kind {
+        TextRecord, ClassRecord, EngineRecord, ObjProxyRecord, QObjectRecord
+    };
+    enum {NameSize = 32};
+
+    qint64 mTime;
+    const char* mVerb;
+    const char* mSrc;
+    const void* mPtr;
+    int mKind;
+    int mSerial;
+    int mCount;
+    // Copied because the class may be gone by the time the record is written.
+    // Names which don't fit are copied to the heap and freed by the writer.
+    char* mLongName;
+    char mName[NameSize];
+
+    void setName(const char*);
+    const char* name() const { return mLongName ? mLongName : mName; }
+};
+
+// Single-producer single-consumer ring of log records owned by one thread.
+class HsQMLLogRing
+{
+public:
+    HsQMLLogRing();
+    bool push(const HsQMLLogRecord&);
+    bool pop(HsQMLLogRecord*);
+    int size() const;
+    void detach();
+    bool detached() const;
+
+    enum {RingSize = 1024, RingMask = RingSize-1};
+
+private:
+    Q_DISABLE_COPY(HsQMLLogRing)
+
+    HsQMLLogRecord mRecords[RingSize];
+    QAtomicInt mHead;
+    char mPad[64];
+    QAtomicInt mTail;
+    QAtomicInt mDetached;
+};
+
+// Formats and writes log records on a background thread. Each logging thread
+// appends binary records to its own ring, so the only work done on the caller
+// is copying the record.
+class HsQMLLogWriter : public QThread
+{
+public:
+    HsQMLLogWriter();
+    ~HsQMLLogWriter();
+    void write(HsQMLLogRecord&);
+    void flush();
+
+protected:
+    void run();
+
+private:
+    Q_DISABLE_COPY(HsQMLLogWriter)
+
+    HsQMLLogRing* ring();
+    void drain();
+
+    QElapsedTimer mClock;
+    QMutex mRingsLock;
+    QVector<HsQMLLogRing*> mRings;
+    QMutex mDrainLock;
+    QVector<HsQMLLogRecord> mBatch;
+    QMutex mWakeLock;
+    QWaitCondition mWake;
+    QWaitCondition mSpace;
+    QAtomicInt mStop;
+};
+
+#endif /*HSQML_LOG_H*/
@@ -1,10 +1,14 @@
-#include <cstdio>
+#include <climits>
 #include <cstdlib>
 #include <QtCore/QBasicTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
 #include <QtCore/QMetaType>
 #include <QtCore/QMutexLocker>
-#include <QtCore/QThread>
+#include <QtCore/QTimerEvent>
+#include <QtGui/QGuiApplication>
 #include <QtQml/QQmlDebuggingEnabler>
+#include <QtWidgets/QApplication>
 #include <QtCore/QDebug>
 #include <QtCore/QProcessEnvironment>
 #include <QtCore/QLoggingCategory>
@@ -13,6 +17,13 @@
 #ifdef Q_OS_MAC
 #include <pthread.h>
 #endif
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/eventfd.h>
+#endif
 
 #include "Canvas.h"
 #include "Class.h"
@@ -33,13 +44,71 @@ static const char* cCounterNames[] = {
     "ClassCounter",
     "ObjectCounter",
     "QObjectCounter",
-    "EngineCounter",
     "VariantCounter",
+    "EngineCounter",
     "ClassSerial",
     "ObjectSerial",
     "EngineSerial",
 };
 
+static const char* cStartupPhaseNames[] = {
+    "init",
+    "event loop start",
+    "application created",
+    "debugger ready",
+    "types registered",
+    "load started",
+    "component ready",
+    "component created",
+    "first frame",
+};
+
+// Qt event priorities used to deliver each lane of jobs. Background jobs are
+// posted at low priority so they queue up behind everything else.
+static const int cJobEventPriorities[] = {
+    Qt::HighEventPriority,
+    Qt::NormalEventPriority,
+    Qt::LowEventPriority,
+};
+
+// A yield which returns quicker than this is taken to mean that there were
+// no other Haskell threads ready to run.
+static const qint64 cYieldIdleNsecs = 20000;
+
+// Maximum interval in milliseconds between yields when idle
+static const int cYieldMaxInterval = 20;
+
+// Milliseconds to wait for a requested frame before running jobs anyway, in
+// case the window stops being exposed before it renders.
+static const int cFrameJobsTimeout = 100;
+
+// Live counts are split into shards, each on its own cache line, so that
+// threads creating and destroying objects don't contend. Threads are given
+// shards round-robin and the counts are summed when read.
+static const int cCounterShards = 16;
+
+struct HsQMLCounterShard {
+    alignas(64) QAtomicInt mCounts[HsQMLManager::ShardedCounters];
+};
+
+static HsQMLCounterShard gCounterShards[cCounterShards];
+static QAtomicInt gCounterShardNext;
+static thread_local int gCounterShard = -1;
+
+static HsQMLCounterShard& counter_shard()
+{
+    if (gCounterShard < 0) {
+        gCounterShard =
+            gCounterShardNext.fetchAndAddRelaxed(1) & (cCounterShards-1);
+    }
+    return gCounterShards[gCounterShard];
+}
+
+// Set on the thread which owns the application object for its lifetime. The
+// QVariant hooks run on every thread in the process and this is cheaper to
+// test than comparing against QThread::currentThread().
+static thread_local bool gIsEventThread = false;
+
 // This definition overrides a symbol in the GHC RTS
 #ifdef HSQML_USE_EXIT_HOOK
 #ifdef Q_OS_LINUX // TODO: Test on other platforms.
@@ -58,10 +127,18 @@ static void dump_counters()
     if (gManager->checkLogLevel(1)) {
         for (int i=0; i<HsQMLManager::TotalCounters; i++) {
             gManager->log(QString().sprintf("%s = %d.",
-                cCounterNames[i], gManager->updateCounter(
-                    static_cast<HsQMLManager::CounterId>(i), 0)));
+                cCounterNames[i], gManager->readCounter(
+                    static_cast<HsQMLManager::CounterId>(i))));
         }
     }
+    gManager->flushLog();
+}
+
+static void close_trace()
+{
+    if (gManager && gManager->tracer()) {
+        gManager->tracer()->close();
+    }
 }
 
 static void hooked_construct(QVariant::Private* p, const void* copy)
@@ -83,18 +160,23 @@ HsQMLManager::HsQMLManager(
     , mAtExit(false)
     , mFreeFun(freeFun)
     , mFreeStable(freeStable)
+    , mFreesPosted(false)
+    , mProfileMetaCalls(0)
+    , mZombieRevivals(0)
     , mOriginalHandler(qcoreVariantHandler())
     , mApp(NULL)
-    , mLock(QMutex::Recursive)
+    , mLoopState(LoopIdle)
+    , mRunState(0)
     , mRunning(false)
-    , mRunCount(0)
-    , mShutdown(false)
     , mStackBase(NULL)
     , mStartCb(NULL)
     , mJobsCb(NULL)
     , mYieldCb(NULL)
     , mActiveEngine(NULL)
     , mQmlDebugEnabled(false)
+    , mFrameSyncJobs(false)
+    , mGuiApplication(false)
+    , mCoreApplication(false)
 {
     // Set default Qt args
     setArgs(QStringList("HsQML"));
@@ -104,6 +186,26 @@ HsQMLManager::HsQMLManager(
     if (env) {
         setLogLevel(QString(env).toInt());
     }
+
+    // Write a trace of activity on the event loop if a file is given
+    const char* tracePath = std::getenv("HSQML_TRACE_FILE");
+    if (tracePath) {
+        mTracer.reset(new HsQMLTracer());
+        if (!mTracer->open(QFile::decodeName(tracePath))) {
+            log(QString().asprintf(
+                "Failed to open trace file '%s'.", tracePath));
+            mTracer.reset();
+        }
+        else if (atexit(&close_trace) != 0) {
+            log("Failed to register callback with atexit().");
+        }
+    }
+
+    // Start the startup timeline
+    for (int i=0; i<StartupPhases; i++) {
+        mStartupTimes[i] = 0;
+    }
+    markStartup(HSQML_STARTUP_INIT);
 }
 
 void HsQMLManager::setLogLevel(int ll)
@@ -126,28 +228,129 @@ bool HsQMLManager::checkLogLevel(int ll)
 
 void HsQMLManager::log(const QString& msg)
 {
-    QMutexLocker locker(&mLogLock);
-    fprintf(stderr, "HsQML: %s\n", msg.toUtf8().data());
+    HsQMLLogRecord rec;
+    rec.mKind = HsQMLLogRecord::TextRecord;
+    rec.mPtr = qstrdup(msg.toUtf8().constData());
+    rec.mLongName = NULL;
+    mLogWriter.write(rec);
+}
+
+void HsQMLManager::logEvent(
+    HsQMLLogRecord::Kind kind, const char* verb, const char* name, int serial,
+    const char* src, int count, const void* ptr)
+{
+    // Only static strings may be referenced by the record, formatting happens
+    // later on the writer thread.
+    HsQMLLogRecord rec;
+    rec.mKind = kind;
+    rec.mVerb = verb;
+    rec.mSrc = src;
+    rec.mPtr = ptr;
+    rec.mSerial = serial;
+    rec.mCount = count;
+    rec.setName(name);
+    mLogWriter.write(rec);
+}
+
+void HsQMLManager::flushLog()
+{
+    mLogWriter.flush();
 }
 
 int HsQMLManager::updateCounter(CounterId id, int delta)
 {
+    // Serials must be unique and so are kept in one place, but the live counts
+    // are sharded and have no meaningful previous value to return.
+    if (id < ShardedCounters) {
+        counter_shard().mCounts[id].fetchAndAddRelaxed(delta);
+        return 0;
+    }
     return mCounters[id].fetchAndAddRelaxed(delta);
 }
 
+int HsQMLManager::readCounter(CounterId id)
+{
+    if (id < ShardedCounters) {
+        int total = 0;
+        for (int i=0; i<cCounterShards; i++) {
+            total += gCounterShards[i].mCounts[id].load();
+        }
+        return total;
+    }
+    return mCounters[id].load();
+}
+
+int HsQMLManager::getCounters(int* values, int count)
+{
+    for (int i=0; i<count && i<TotalCounters; i++) {
+        values[i] = readCounter(static_cast<CounterId>(i));
+    }
+    return TotalCounters;
+}
+
 void HsQMLManager::freeFun(HsFunPtr funPtr)
 {
-    mFreeFun(funPtr);
+    // Releases made on the event loop thread are batched so that tearing
+    // down a large view doesn't pay for them one at a time.
+    if (gIsEventThread) {
+        mPendingFuns.append(funPtr);
+        queueFrees();
+    }
+    else {
+        mFreeFun(funPtr);
+    }
 }
 
 void HsQMLManager::freeStable(HsStablePtr stablePtr)
 {
-    mFreeStable(stablePtr);
+    if (gIsEventThread) {
+        mPendingStables.append(stablePtr);
+        queueFrees();
+    }
+    else {
+        mFreeStable(stablePtr);
+    }
+}
+
+void HsQMLManager::queueFrees()
+{
+    if (mPendingFuns.size() + mPendingStables.size() >= FreeBatchSize) {
+        flushFrees();
+    }
+    else if (!mFreesPosted && mRunning) {
+        // Release the batch once the events already queued are handled
+        mFreesPosted = true;
+        QCoreApplication::postEvent(
+            mApp, new QEvent(HsQMLManagerApp::FreeEvent),
+            Qt::LowEventPriority);
+    }
+}
+
+void HsQMLManager::flushFrees()
+{
+    mFreesPosted = false;
+    if (mPendingFuns.isEmpty() && mPendingStables.isEmpty()) {
+        return;
+    }
+
+    HsQMLTraceSpan span(mTracer.data(), "gc", "freeBatch");
+    if (span.isActive()) {
+        span.addArg("funs", mPendingFuns.size());
+        span.addArg("stables", mPendingStables.size());
+    }
+    for (int i=0; i<mPendingFuns.size(); i++) {
+        mFreeFun(mPendingFuns[i]);
+    }
+    mPendingFuns.clear();
+    for (int i=0; i<mPendingStables.size(); i++) {
+        mFreeStable(mPendingStables[i]);
+    }
+    mPendingStables.clear();
 }
 
 bool HsQMLManager::setArgs(const QStringList& args)
 {
-    if (mApp || mShutdown) {
+    if (mApp || mLoopState.loadAcquire() == LoopShutdown) {
         return false;
     }
 
@@ -169,7 +372,7 @@ QVector<char*>& HsQMLManager::argsPtrs()
 
 bool HsQMLManager::setFlag(HsQMLGlobalFlag flag, bool value)
 {
-    if (mApp || mShutdown) {
+    if (mApp || mLoopState.loadAcquire() == LoopShutdown) {
         return false;
     }
 
@@ -182,6 +385,17 @@ bool HsQMLManager::setFlag(HsQMLGlobalFlag flag, bool value)
     case HSQML_GFLAG_ENABLE_QML_DEBUG:
         mQmlDebugEnabled = value;
         return true;
+#if QT_VERSION >= 0x050300
+    case HSQML_GFLAG_FRAME_SYNC_JOBS:
+        mFrameSyncJobs = value;
+        return true;
+#endif
+    case HSQML_GFLAG_GUI_APPLICATION:
+        mGuiApplication = value;
+        return true;
+    case HSQML_GFLAG_CORE_APPLICATION:
+        mCoreApplication = value;
+        return true;
     }
     return false;
 }
@@ -195,6 +409,12 @@ bool HsQMLManager::getFlag(HsQMLGlobalFlag flag)
 #endif
     case HSQML_GFLAG_ENABLE_QML_DEBUG:
         return mQmlDebugEnabled;
+    case HSQML_GFLAG_FRAME_SYNC_JOBS:
+        return mFrameSyncJobs;
+    case HSQML_GFLAG_GUI_APPLICATION:
+        return mGuiApplication;
+    case HSQML_GFLAG_CORE_APPLICATION:
+        return mCoreApplication;
     }
     return false;
 }
@@ -210,6 +430,67 @@ void HsQMLManager::unregisterObject(const QObject* obj)
     Q_ASSERT(removed);
 }
 
+void HsQMLManager::registerClass(HsQMLClass* klass)
+{
+    QMutexLocker locker(&mClassLock);
+    mClasses.append(klass);
+}
+
+void HsQMLManager::unregisterClass(HsQMLClass* klass)
+{
+    QMutexLocker locker(&mClassLock);
+    mClasses.removeOne(klass);
+}
+
+void HsQMLManager::setMetaCallProfiling(bool enable)
+{
+    mProfileMetaCalls.store(enable);
+}
+
+void HsQMLManager::reportMetaCalls(HsQMLMetaCallStatsCb cb)
+{
+    QVector<HsQMLClass::MetaCallRecord> records;
+    mClassLock.lock();
+    Q_FOREACH(HsQMLClass* klass, mClasses) {
+        klass->collectMetaCalls(records);
+    }
+    mClassLock.unlock();
+
+    // The callback runs Haskell code which could finalise a class, and that
+    // would need the lock.
+    for (int i=0; i<records.size(); i++) {
+        const HsQMLClass::MetaCallRecord& rec = records[i];
+        cb(rec.mClass.constData(), rec.mMember.constData(), rec.mKind,
+            rec.mCount, rec.mBuckets, HsQMLClass::MetaCallBuckets);
+    }
+}
+
+bool HsQMLManager::markStartup(HsQMLStartupPhase phase)
+{
+    // Only the first time each phase is reached is part of the timeline
+    qint64 time = HsQMLStallProfiler::now();
+    QMutexLocker locker(&mStartupLock);
+    if (mStartupTimes[phase]) {
+        return false;
+    }
+    mStartupTimes[phase] = time;
+    if (checkLogLevel(1)) {
+        log(QString().asprintf("Startup phase '%s' reached at %.3f ms.",
+            cStartupPhaseNames[phase],
+            (time - mStartupTimes[HSQML_STARTUP_INIT])/1000000.0));
+    }
+    return true;
+}
+
+int HsQMLManager::getStartupTimeline(qint64* times, int count)
+{
+    QMutexLocker locker(&mStartupLock);
+    for (int i=0; i<StartupPhases && i<count; i++) {
+        times[i] = mStartupTimes[i];
+    }
+    return StartupPhases;
+}
+
 void HsQMLManager::hookedConstruct(QVariant::Private* p, const void* copy)
 {
     char guard;
@@ -225,7 +506,7 @@ void HsQMLManager::hookedConstruct(QVariant::Private* p, const void* copy)
     // that the stack can be discounted, it's possible to keep an accurate
     // count of heap references using these hooks.
     if ((pp < &guard || pp > mStackBase) && p->type == QMetaType::QObjectStar) {
-        if (isEventThread() && mObjectSet.contains(p->data.o)) {
+        if (gIsEventThread && mObjectSet.contains(p->data.o)) {
             HsQMLObject* obj = static_cast<HsQMLObject*>(p->data.o);
             HsQMLObjectProxy* proxy = obj->proxy();
             proxy->ref(HsQMLObjectProxy::Variant);
@@ -240,7 +521,7 @@ void HsQMLManager::hookedClear(QVariant::Private* p)
     char guard;
     void* pp = reinterpret_cast<void*>(p);
     if ((pp < &guard || pp > mStackBase) && p->type == QMetaType::QObjectStar) {
-        if (isEventThread() && mObjectSet.contains(p->data.o)) {
+        if (gIsEventThread && mObjectSet.contains(p->data.o)) {
             HsQMLObject* obj = static_cast<HsQMLObject*>(p->data.o);
             obj->proxy()->deref(HsQMLObjectProxy::Variant);
             updateCounter(VariantCount, -1);
@@ -251,26 +532,24 @@ void HsQMLManager::hookedClear(QVariant::Private* p)
 
 bool HsQMLManager::isEventThread()
 {
-    return mApp && mApp->thread() == QThread::currentThread();
+    return gIsEventThread;
 }
 
 HsQMLManager::EventLoopStatus HsQMLManager::runEventLoop(
     HsQMLTrivialCb startCb,
-    HsQMLTrivialCb jobsCb,
+    HsQMLJobsCb jobsCb,
     HsQMLTrivialCb yieldCb)
 {
-    QMutexLocker locker(&mLock);
-
     // Check for invalid state
-    if (mRunning) {
-        return HSQML_EVLOOP_ALREADY_RUNNING;
-    }
-    else if (mShutdown) {
-        return HSQML_EVLOOP_POST_SHUTDOWN;
+    LoopState prevState = enterLoopState(LoopActive);
+    if (prevState != LoopIdle) {
+        return prevState == LoopActive ?
+            HSQML_EVLOOP_ALREADY_RUNNING : HSQML_EVLOOP_POST_SHUTDOWN;
     }
 
     // Check if event loop bound to a different thread
     if (mApp && !isEventThread()) {
+        mLoopState.storeRelease(LoopIdle);
         return HSQML_EVLOOP_WRONG_THREAD;
     }
 
@@ -278,23 +557,20 @@ HsQMLManager::EventLoopStatus HsQMLManager::runEventLoop(
     if (!pthread_main_np()) {
         // Cocoa can only be run on the primordial thread and exec() doesn't
         // check this.
+        mLoopState.storeRelease(LoopIdle);
         return HSQML_EVLOOP_WRONG_THREAD;
     }
 #endif
 
-    // Check for non-threaded RTS
-    if (yieldCb) {
-        HSQML_LOG(0,
-            "Warning: CPU cannot idle when using the non-threaded RTS.");
-    }
-
     // Create application object
     if (!mApp) {
+        markStartup(HSQML_STARTUP_EVLOOP_START);
         mApp = new HsQMLManagerApp();
     }
 
     // Save stack base and callbacks
-    mStackBase = &locker;
+    char stackBase;
+    mStackBase = &stackBase;
     mStartCb = startCb;
     mJobsCb = jobsCb;
     mYieldCb = yieldCb;
@@ -303,9 +579,9 @@ HsQMLManager::EventLoopStatus HsQMLManager::runEventLoop(
     QCoreApplication::postEvent(
         mApp, new QEvent(HsQMLManagerApp::StartedLoopEvent),
         Qt::HighEventPriority);
-    QBasicTimer idleTimer;
     if (yieldCb) {
-        idleTimer.start(0, mApp);
+        // The non-threaded RTS only runs other Haskell threads when called
+        mApp->startYield();
     }
 
     // Run loop
@@ -323,19 +599,29 @@ HsQMLManager::EventLoopStatus HsQMLManager::runEventLoop(
         // Keep it running until a StopLoopEvent is received
     } while (ret == 0 && mRunning);
 
-    // Remove redundant events
+    // Remove redundant events, but empty the queue which they were for so
+    // that the next proxy to be queued posts another.
     QCoreApplication::removePostedEvents(
         mApp, HsQMLManagerApp::RemoveGCLockEvent);
+    HsQMLObjectProxy::removePendingGCLocks();
 
     // Cleanup callbacks
+    if (yieldCb) {
+        mApp->stopYield();
+    }
     freeFun(startCb);
     mStartCb = NULL;
-    freeFun(jobsCb);
+    freeFun(reinterpret_cast<HsFunPtr>(jobsCb));
     mJobsCb = NULL;
     if (yieldCb) {
         freeFun(yieldCb);
         mYieldCb = NULL;
     }
+    flushFrees();
+
+    // A loop which failed without being stopped still holds its references,
+    // so it stays active and can't be run again.
+    mLoopState.storeRelease(mRunning ? LoopActive : LoopIdle);
 
     // Return
     if (ret == 0) {
@@ -348,37 +634,195 @@ HsQMLManager::EventLoopStatus HsQMLManager::runEventLoop(
     }
 }
 
+HsQMLManager::LoopState HsQMLManager::enterLoopState(LoopState state)
+{
+    // Moves from idle to the given state and returns the state which was
+    // left, so anything other than idle means that it failed.
+    for (;;) {
+        if (mLoopState.testAndSetOrdered(LoopIdle, state)) {
+            return LoopIdle;
+        }
+        int current = mLoopState.loadAcquire();
+        if (current != LoopIdle) {
+            return static_cast<LoopState>(current);
+        }
+    }
+}
+
 HsQMLManager::EventLoopStatus HsQMLManager::requireEventLoop()
 {
-    QMutexLocker locker(&mLock);
-    if (mRunCount > 0) {
-        mRunCount++;
+    if (acquireRun()) {
         return HSQML_EVLOOP_OK;
     }
-    else {
-        return HSQML_EVLOOP_NOT_RUNNING;
-    }
+
+    // The loop is active from when it is entered but only accepts references
+    // once it has started, so callers in between are told to try again. This
+    // is also returned while a stopped loop is exiting, after which retrying
+    // gives NOT_RUNNING.
+    return mLoopState.loadAcquire() == LoopActive ?
+        HSQML_EVLOOP_STARTING : HSQML_EVLOOP_NOT_RUNNING;
 }
 
 void HsQMLManager::releaseEventLoop()
 {
-    QMutexLocker locker(&mLock);
-    if (--mRunCount == 0) {
+    releaseRun();
+}
+
+// The run state is a flag, set while the event loop is running and accepting
+// new references, plus a count of references in units of RunRef. References
+// are taken unconditionally and handed back if the flag was clear, so taking
+// one never waits. Only the thread which drops the count to zero can clear
+// the flag, so the loop can't stop while any reference is held.
+bool HsQMLManager::acquireRun()
+{
+    if (mRunState.fetchAndAddOrdered(RunRef) & RunFlag) {
+        return true;
+    }
+    mRunState.fetchAndAddOrdered(-RunRef);
+    return false;
+}
+
+void HsQMLManager::releaseRun()
+{
+    if (mRunState.fetchAndAddOrdered(-RunRef) == RunFlag+RunRef &&
+        mRunState.testAndSetOrdered(RunFlag, 0)) {
         QCoreApplication::postEvent(
             mApp, new QEvent(HsQMLManagerApp::StopLoopEvent),
             Qt::LowEventPriority);
     }
 }
 
-void HsQMLManager::notifyJobs()
+void HsQMLManager::postJob(HsStablePtr job, HsQMLJobPriority prio)
 {
-    QMutexLocker locker(&mLock);
-    if (mRunCount > 0) {
-        QCoreApplication::postEvent(
-            mApp, new QEvent(HsQMLManagerApp::PendingJobsEvent));
+    mJobQueues[prio].push(job);
+    wakeJobs(prio);
+
+    // Haskell threads may be waiting on the job, so stop backing off
+    if (mYieldCb) {
+        mApp->wakeYield();
+    }
+}
+
+void HsQMLManager::wakeJobs(HsQMLJobPriority prio, bool deferred)
+{
+    // Only the thread which raises a lane's wakeup flag posts an event, so
+    // there is never more than one PendingJobsEvent in flight per lane.
+    if (mJobsWakeup[prio].testAndSetOrdered(0, 1)) {
+        // Holding a reference keeps the application alive while posting
+        if (acquireRun()) {
+            QCoreApplication::postEvent(
+                mApp, new HsQMLJobsEvent(prio), deferred ?
+                Qt::LowEventPriority : cJobEventPriorities[prio]);
+            releaseRun();
+        }
+        else {
+            // The queue will be drained when the event loop next starts
+            mJobsWakeup[prio].storeRelease(0);
+        }
+    }
+}
+
+void HsQMLManager::runJobs(HsQMLJobPriority prio)
+{
+    Q_ASSERT(isEventThread());
+
+    // Lower the flag before draining so that any job posted from here on
+    // raises a fresh wakeup rather than being stranded in the queue.
+    mJobsWakeup[prio].fetchAndStoreOrdered(0);
+    drainJobs(prio);
+}
+
+bool HsQMLManager::requestJobsFrame()
+{
+    if (!mFrameSyncJobs) {
+        return false;
+    }
+
+    // Leave the wakeup flags raised until the frame flushes the jobs
+    bool requested = false;
+    Q_FOREACH(QObject* child, mApp->children()) {
+        HsQMLEngine* engine = qobject_cast<HsQMLEngine*>(child);
+        if (engine && engine->requestFrame()) {
+            requested = true;
+        }
+    }
+    if (requested) {
+        mApp->startFrameTimeout();
+    }
+    return requested;
+}
+
+void HsQMLManager::runFrameJobs()
+{
+    Q_ASSERT(isEventThread());
+
+    mApp->stopFrameTimeout();
+    for (int i=0; i<JobLanes; i++) {
+        mJobsWakeup[i].fetchAndStoreOrdered(0);
+    }
+    drainJobs(HSQML_JOB_BACKGROUND);
+}
+
+void HsQMLManager::drainJobs(HsQMLJobPriority prio)
+{
+    // Without a time budget, everything pending is run in one batch.
+    // Otherwise, jobs are run in small chunks until the budget runs out.
+    qint64 budget = static_cast<qint64>(mJobBudget.load())*1000;
+    int chunk = budget > 0 ? JobChunkSize : INT_MAX;
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<HsStablePtr> jobs;
+    for (;;) {
+        // Higher priority lanes are drained ahead of this one, whether or not
+        // their own events have been delivered yet. Their flags are left
+        // alone so that the events already in flight stay accounted for.
+        jobs.clear();
+        for (int i=0; i<=prio && jobs.size()<chunk; i++) {
+            mJobQueues[i].take(jobs, chunk-jobs.size());
+        }
+        if (jobs.isEmpty()) {
+            mJobBacklog.store(0);
+            return;
+        }
+        {
+            HsQMLTraceSpan span(mTracer.data(), "jobs", "runJobs");
+            if (span.isActive()) {
+                span.addArg("lane", prio);
+                span.addArg("count", jobs.size());
+            }
+            HsQMLStallScope stall(stallProfiler(), HSQML_STALL_JOBS);
+            mJobsCb(jobs.data(), jobs.size());
+        }
+        if (budget > 0 && timer.nsecsElapsed() >= budget) {
+            break;
+        }
+    }
+
+    // Out of time, so yield to Qt and continue from a low priority event
+    int backlog = 0;
+    for (int i=0; i<=prio; i++) {
+        backlog += mJobQueues[i].backlog();
+    }
+    mJobBacklog.store(backlog);
+    if (backlog > 0) {
+        HSQML_LOG(2,
+            QString().asprintf("Job budget exhausted, lane=%d, backlog=%d.",
+            prio, backlog));
+        wakeJobs(prio, true);
     }
 }
 
+void HsQMLManager::setJobBudget(int usecs)
+{
+    mJobBudget.store(usecs);
+}
+
+int HsQMLManager::jobBacklog()
+{
+    return mJobBacklog.load();
+}
+
 void HsQMLManager::setActiveEngine(HsQMLEngine* engine)
 {
     Q_ASSERT(!mActiveEngine || !engine);
@@ -397,39 +841,106 @@ void HsQMLManager::postAppEvent(QEvent* ev)
 
 void HsQMLManager::zombifyClass(HsQMLClass* clazz)
 {
+    QMutexLocker locker(&mClassLock);
     if (mApp) {
-        mZombieClasses << clazz;
+        mZombieClasses.insert(clazz->structHash(), clazz);
     }
     else {
         delete clazz;
     }
 }
 
+HsQMLClass* HsQMLManager::reviveClass(
+    const unsigned int* metaData,
+    const unsigned int* metaStrInfo,
+    const char* metaStrChar)
+{
+    uint hash = HsQMLClass::structureHash(metaData, metaStrInfo, metaStrChar);
+    QMutexLocker locker(&mClassLock);
+    QMultiHash<uint, HsQMLClass*>::iterator it = mZombieClasses.find(hash);
+    for (; it != mZombieClasses.end() && it.key() == hash; ++it) {
+        HsQMLClass* clazz = it.value();
+        if (clazz->hasStructure(metaData, metaStrInfo, metaStrChar)) {
+            mZombieClasses.erase(it);
+            mZombieRevivals++;
+            HSQML_LOG(2, QString().asprintf(
+                "Reviving zombie class, name=%s.", clazz->name()));
+            return clazz;
+        }
+    }
+    return NULL;
+}
+
+int HsQMLManager::getZombieStats(qint64* values, int count)
+{
+    // Number of zombies, bytes pinned by them, and revivals so far
+    QMutexLocker locker(&mClassLock);
+    qint64 stats[3] = {mZombieClasses.size(), 0, mZombieRevivals};
+    Q_FOREACH(HsQMLClass* clazz, mZombieClasses) {
+        stats[1] += clazz->pinnedSize();
+    }
+    for (int i=0; i<3 && i<count; i++) {
+        values[i] = stats[i];
+    }
+    return 3;
+}
+
 HsQMLManager::EventLoopStatus HsQMLManager::shutdown()
 {
-    QMutexLocker locker(&mLock);
+    // Shutdown has to happen on the event loop's thread, if there is one.
+    // Other threads leave the loop state alone so that they can't make
+    // concurrent calls see a shutdown which isn't going to happen.
+    if (!isEventThread()) {
+        if (mLoopState.loadAcquire() == LoopActive) {
+            return HSQML_EVLOOP_ALREADY_RUNNING;
+        }
+        return mApp ? HSQML_EVLOOP_WRONG_THREAD : HSQML_EVLOOP_OK;
+    }
 
-    if (mRunning) {
-        return HSQML_EVLOOP_ALREADY_RUNNING;
+    LoopState prevState = enterLoopState(LoopShutdown);
+    if (prevState != LoopIdle) {
+        // Shutting down twice has no further effect
+        return prevState == LoopActive ?
+            HSQML_EVLOOP_ALREADY_RUNNING : HSQML_EVLOOP_OK;
     }
-    else if (isEventThread()) {
-        HSQML_LOG(1, "Deleting QApplication object.");
-        delete mApp;
-        mApp = NULL;
-        mShutdown = true;
+
+    // Release jobs which can no longer be run
+    QVector<HsStablePtr> jobs;
+    for (int i=0; i<JobLanes; i++) {
+        mJobQueues[i].takeAll(jobs);
     }
-    else if (mApp) {
-        return HSQML_EVLOOP_WRONG_THREAD; 
+    Q_FOREACH(HsStablePtr job, jobs) {
+        freeStable(job);
     }
+
+    HSQML_LOG(1, "Deleting application object.");
+    delete mApp;
+    mApp = NULL;
+    flushFrees();
     return HSQML_EVLOOP_OK;
 }
 
+static QCoreApplication* create_application(int& argc, char** argv)
+{
+    // Avoid initialising QtWidgets and its style plugins unless needed
+    if (gManager->getFlag(HSQML_GFLAG_CORE_APPLICATION)) {
+        return new QCoreApplication(argc, argv);
+    }
+    else if (gManager->getFlag(HSQML_GFLAG_GUI_APPLICATION)) {
+        return new QGuiApplication(argc, argv);
+    }
+    return new QApplication(argc, argv);
+}
+
 HsQMLManagerApp::HsQMLManagerApp()
-    : mHookedHandler(*gManager->mOriginalHandler)
+    : mYieldInterval(0)
+    , mHookedHandler(*gManager->mOriginalHandler)
     , mArgC(gManager->argsPtrs().size())
-    , mApp(mArgC, gManager->argsPtrs().data())
+    , mApp(create_application(mArgC, gManager->argsPtrs().data()))
 {
+    gIsEventThread = true;
     gManager->argsPtrs().resize(mArgC);
+    gManager->markStartup(HSQML_STARTUP_APP_CREATED);
 
     // Only enable debugging if the flag is set
     if (gManager->getFlag(HSQML_GFLAG_ENABLE_QML_DEBUG)) {
@@ -457,7 +968,32 @@ HsQMLManagerApp::HsQMLManagerApp()
         }
     }
 
-    mApp.setQuitOnLastWindowClosed(false);
+    gManager->markStartup(HSQML_STARTUP_DEBUG_READY);
+    if (qobject_cast<QGuiApplication*>(mApp.data())) {
+        QGuiApplication::setQuitOnLastWindowClosed(false);
+    }
+
+    // Create descriptor for waking the non-threaded RTS's yield timer
+    mYieldFds[0] = mYieldFds[1] = -1;
+#if defined(Q_OS_LINUX)
+    mYieldFds[0] = mYieldFds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif defined(Q_OS_UNIX)
+    if (pipe(mYieldFds) == 0) {
+        for (int i=0; i<2; i++) {
+            fcntl(mYieldFds[i], F_SETFL, O_NONBLOCK);
+            fcntl(mYieldFds[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+#endif
+    if (mYieldFds[0] >= 0) {
+        // Not a child because children are deleted when the loop exits
+        mYieldNotifier.reset(
+            new QSocketNotifier(mYieldFds[0], QSocketNotifier::Read));
+        mYieldNotifier->setEnabled(false);
+        QObject::connect(
+            mYieldNotifier.data(), SIGNAL(activated(int)),
+            this, SLOT(yieldNotified()));
+    }
 
     // Install hooked handler for QVariants
     mHookedHandler.construct = &hooked_construct;
@@ -470,14 +1006,38 @@ HsQMLManagerApp::HsQMLManagerApp()
         "HsQML.Canvas", 1, 0, "OpenGLContextControl");
     qmlRegisterType<HsQMLAutoListModel>(
         "HsQML.Model", 1, 0, "AutoListModel");
-    qmlRegisterType<HsQMLClipboardHelper>(
-        "HsQML.Clipboard", 1, 0, "ClipboardHelper");
+    // The clipboard needs a QGuiApplication, so without one the import fails
+    if (!gManager->getFlag(HSQML_GFLAG_CORE_APPLICATION)) {
+        qmlRegisterType<HsQMLClipboardHelper>(
+            "HsQML.Clipboard", 1, 0, "ClipboardHelper");
+    }
+    gManager->markStartup(HSQML_STARTUP_TYPES_REGISTERED);
 }
 
 HsQMLManagerApp::~HsQMLManagerApp()
 {
+    mYieldNotifier.reset();
+#ifdef Q_OS_UNIX
+    if (mYieldFds[0] >= 0) {
+        close(mYieldFds[0]);
+    }
+    if (mYieldFds[1] != mYieldFds[0]) {
+        close(mYieldFds[1]);
+    }
+#endif
+
+    gManager->mClassLock.lock();
     qDeleteAll(gManager->mZombieClasses);
     gManager->mZombieClasses.clear();
+    gManager->mClassLock.unlock();
+
+    // The application is deleted here rather than as a member so that this
+    // is still the event thread, and the hooks still run, while it goes.
+    mApp.reset();
+
+    // Restore the original handler as this one is about to be freed
+    QVariantPrivate::registerHandler(0, gManager->mOriginalHandler);
+    gIsEventThread = false;
 }
 
 void HsQMLManagerApp::customEvent(QEvent* ev)
@@ -485,21 +1045,39 @@ void HsQMLManagerApp::customEvent(QEvent* ev)
     switch (ev->type()) {
     case HsQMLManagerApp::StartedLoopEvent: {
         gManager->mRunning = true;
-        gManager->mRunCount++;
-        gManager->mLock.unlock();
-        gManager->mStartCb();
-        gManager->mJobsCb();
+        gManager->mRunState.fetchAndAddOrdered(
+            HsQMLManager::RunFlag+HsQMLManager::RunRef);
+        {
+            HsQMLStallScope stall(
+                gManager->stallProfiler(), HSQML_STALL_START);
+            gManager->mStartCb();
+        }
+        gManager->runJobs(HSQML_JOB_NORMAL);
+        gManager->wakeJobs(HSQML_JOB_BACKGROUND);
         break;}
     case HsQMLManagerApp::StopLoopEvent: {
-        gManager->mLock.lock();
         gManager->mRunning = false;
-        gManager->mApp->mApp.quit();
+        gManager->mApp->mApp->quit();
         break;}
     case HsQMLManagerApp::PendingJobsEvent: {
-        gManager->mJobsCb();
+        // In frame synchronised mode the jobs are flushed by the next frame
+        // instead, unless there are no windows to produce one.
+        if (!gManager->requestJobsFrame()) {
+            gManager->runJobs(static_cast<HsQMLJobsEvent*>(ev)->priority());
+        }
         break;}
     case HsQMLManagerApp::RemoveGCLockEvent: {
-        static_cast<HsQMLObjectEvent*>(ev)->process();
+        HsQMLTraceSpan span(gManager->tracer(), "gc", "removeGCLocks");
+        int count = HsQMLObjectProxy::removePendingGCLocks();
+        if (span.isActive()) {
+            span.addArg("proxies", count);
+        }
+        break;}
+    case HsQMLManagerApp::WakeYieldEvent: {
+        yieldNotified();
+        break;}
+    case HsQMLManagerApp::FreeEvent: {
+        gManager->flushFrees();
         break;}
     case HsQMLManagerApp::CreateEngineEvent: {
         HsQMLEngineCreateEvent* create =
@@ -515,21 +1093,126 @@ void HsQMLManagerApp::customEvent(QEvent* ev)
     }
 }
 
-void HsQMLManagerApp::timerEvent(QTimerEvent*)
+void HsQMLManagerApp::timerEvent(QTimerEvent* ev)
+{
+    if (ev->timerId() == mFrameTimer.timerId()) {
+        // The requested frame never came, so flush the jobs without it
+        gManager->runFrameJobs();
+    }
+    else {
+        runYield();
+    }
+}
+
+void HsQMLManagerApp::startFrameTimeout()
+{
+    if (!mFrameTimer.isActive()) {
+        mFrameTimer.start(cFrameJobsTimeout, this);
+    }
+}
+
+void HsQMLManagerApp::stopFrameTimeout()
+{
+    mFrameTimer.stop();
+}
+
+void HsQMLManagerApp::startYield()
+{
+    mYieldInterval = 0;
+    mYieldIdle.store(0);
+    mYieldTimer.start(0, this);
+    if (mYieldNotifier) {
+        mYieldNotifier->setEnabled(true);
+    }
+}
+
+void HsQMLManagerApp::stopYield()
+{
+    mYieldTimer.stop();
+    if (mYieldNotifier) {
+        mYieldNotifier->setEnabled(false);
+    }
+    QCoreApplication::removePostedEvents(this, WakeYieldEvent);
+}
+
+void HsQMLManagerApp::runYield()
 {
     Q_ASSERT(gManager->mYieldCb);
-    gManager->mYieldCb();
+    QElapsedTimer timer;
+    timer.start();
+    {
+        HsQMLStallScope stall(gManager->stallProfiler(), HSQML_STALL_YIELD);
+        gManager->mYieldCb();
+    }
+
+    // Back off exponentially while there are no other Haskell threads to run
+    // rather than spinning the CPU. Any sign of new work resets the interval.
+    int interval = 0;
+    if (timer.nsecsElapsed() < cYieldIdleNsecs) {
+        interval = qBound(1, mYieldInterval*2, cYieldMaxInterval);
+    }
+    if (interval != mYieldInterval) {
+        mYieldInterval = interval;
+        mYieldIdle.storeRelease(interval > 0);
+        mYieldTimer.start(interval, this);
+    }
+}
+
+void HsQMLManagerApp::wakeYield()
+{
+    // May be called from any thread, but only signals when backed off
+    if (!mYieldIdle.testAndSetOrdered(1, 0)) {
+        return;
+    }
+    if (mYieldFds[1] >= 0) {
+#ifdef Q_OS_UNIX
+        // An eventfd requires 8 bytes while a pipe will take any amount
+        quint64 value = 1;
+        ssize_t ret = write(mYieldFds[1], &value, sizeof(value));
+        Q_UNUSED(ret);
+#endif
+    }
+    else {
+        QCoreApplication::postEvent(this, new QEvent(WakeYieldEvent));
+    }
+}
+
+void HsQMLManagerApp::yieldNotified()
+{
+#ifdef Q_OS_UNIX
+    if (mYieldFds[0] >= 0) {
+        quint64 value;
+        while (read(mYieldFds[0], &value, sizeof(value)) > 0) {}
+    }
+#endif
+    if (gManager->mYieldCb) {
+        mYieldInterval = 0;
+        mYieldIdle.storeRelease(0);
+        mYieldTimer.start(0, this);
+    }
+}
+
+HsQMLJobsEvent::HsQMLJobsEvent(HsQMLJobPriority prio)
+    : QEvent(HsQMLManagerApp::PendingJobsEvent)
+    , mPriority(prio)
+{}
+
+HsQMLJobPriority HsQMLJobsEvent::priority() const
+{
+    return mPriority;
 }
 
 int HsQMLManagerApp::exec()
 {
-    return mApp.exec();
+    return mApp->exec();
 }
 
 void HsQMLManagerApp::setWindowIcon(QIcon* icon)
 {
     if (icon != nullptr) {
-        mApp.setWindowIcon(*icon);
+        if (qobject_cast<QGuiApplication*>(mApp.data())) {
+            QGuiApplication::setWindowIcon(*icon);
+        }
         delete icon;
     }
 }
@@ -590,7 +1273,7 @@ extern "C" int hsqml_get_flag(HsQMLGlobalFlag flag)
 
 extern "C" HsQMLEventLoopStatus hsqml_evloop_run(
     HsQMLTrivialCb startCb,
-    HsQMLTrivialCb jobsCb,
+    HsQMLJobsCb jobsCb,
     HsQMLTrivialCb yieldCb)
 {
     return gManager->runEventLoop(startCb, jobsCb, yieldCb);
@@ -606,9 +1289,20 @@ extern "C" void hsqml_evloop_release()
     gManager->releaseEventLoop();
 }
 
-extern "C" void hsqml_evloop_notify_jobs()
+extern "C" void hsqml_evloop_post_job(
+    HsStablePtr job, HsQMLJobPriority prio)
+{
+    gManager->postJob(job, prio);
+}
+
+extern "C" void hsqml_evloop_set_job_budget(int usecs)
 {
-    gManager->notifyJobs();
+    gManager->setJobBudget(usecs);
+}
+
+extern "C" int hsqml_evloop_get_job_backlog()
+{
+    return gManager->jobBacklog();
 }
 
 extern "C" HsQMLEventLoopStatus hsqml_evloop_shutdown()
@@ -625,6 +1319,56 @@ extern "C" void hsqml_set_debug_loglevel(int ll)
     gManager->setLogLevel(ll);
 }
 
+extern "C" int hsqml_get_counters(int* values, int count)
+{
+    Q_ASSERT (gManager);
+    return gManager->getCounters(values, count);
+}
+
+extern "C" void hsqml_set_metacall_profiling(int enable)
+{
+    Q_ASSERT (gManager);
+    gManager->setMetaCallProfiling(enable);
+}
+
+extern "C" void hsqml_get_metacall_stats(HsQMLMetaCallStatsCb cb)
+{
+    Q_ASSERT (gManager);
+    gManager->reportMetaCalls(cb);
+}
+
+extern "C" int hsqml_get_zombie_stats(long long* values, int count)
+{
+    Q_ASSERT (gManager);
+    return gManager->getZombieStats(values, count);
+}
+
+extern "C" int hsqml_get_startup_timeline(long long* times, int count)
+{
+    Q_ASSERT (gManager);
+    return gManager->getStartupTimeline(times, count);
+}
+
+extern "C" void hsqml_set_stall_threshold(int usecs)
+{
+    Q_ASSERT (gManager);
+    gManager->stallStats().setThreshold(usecs);
+}
+
+extern "C" int hsqml_get_worst_stalls(
+    int* sites, long long* starts, long long* durations, int max)
+{
+    Q_ASSERT (gManager);
+    return gManager->stallStats().worstStalls(
+        sites, starts, durations, max);
+}
+
+extern "C" int hsqml_get_stall_summary(long long* values, int count)
+{
+    Q_ASSERT (gManager);
+    return gManager->stallStats().summary(values, count);
+}
+
 extern "C" void hsqml_set_window_icon(const char* iconPath) {
     if (gManager) {
         gManager->setWindowIcon(QString::fromUtf8(iconPath));
@@ -4,18 +4,28 @@
 #include <QtCore/QAtomicPointer>
 #include <QtCore/QAtomicInt>
 #include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QBasicTimer>
+#include <QtCore/QCoreApplication>
 #include <QtCore/QMutex>
-#include <QtCore/QSet>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QSocketNotifier>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtCore/QVariant>
 #include <QtCore/QVector>
-#include <QtWidgets/QApplication>
 #include <QtGui/QIcon>
 
 #include "hsqml.h"
+#include "JobQueue.h"
+#include "Log.h"
+#include "ObjectSet.h"
+#include "Stall.h"
+#include "Trace.h"
 
 #define HSQML_LOG(ll, msg) if (gManager->checkLogLevel(ll)) gManager->log(msg)
+#define HSQML_LOG_EVENT(ll, ...) \
+    if (gManager->checkLogLevel(ll)) gManager->logEvent(__VA_ARGS__)
 
 class HsQMLManagerApp;
 class HsQMLClass;
@@ -33,37 +43,68 @@ public:
         ClassSerial,
         ObjectSerial,
         EngineSerial,
-        TotalCounters
+        TotalCounters,
+        ShardedCounters = ClassSerial
     }; 
 
+    enum {JobLanes = HSQML_JOB_BACKGROUND+1, JobChunkSize = 32};
+    enum {StartupPhases = HSQML_STARTUP_FIRST_FRAME+1};
+    enum {FreeBatchSize = 4096};
+
     HsQMLManager(
         void (*)(HsFunPtr),
         void (*)(HsStablePtr));
     void setLogLevel(int);
     bool checkLogLevel(int);
     void log(const QString&);
+    void logEvent(HsQMLLogRecord::Kind, const char*, const char*, int,
+        const char*, int, const void* = NULL);
+    void flushLog();
+    HsQMLTracer* tracer() const { return mTracer.data(); }
+    HsQMLStallProfiler* stallProfiler()
+        { return mStallProfiler.enabled() ? &mStallProfiler : NULL; }
+    HsQMLStallProfiler& stallStats() { return mStallProfiler; }
     int updateCounter(CounterId, int);
+    int readCounter(CounterId);
+    int getCounters(int*, int);
     void freeFun(HsFunPtr);
     void freeStable(HsStablePtr);
+    void flushFrees();
     bool setArgs(const QStringList&);
     QVector<char*>& argsPtrs();
     bool setFlag(HsQMLGlobalFlag, bool);
     bool getFlag(HsQMLGlobalFlag);
     void registerObject(const QObject*);
     void unregisterObject(const QObject*);
+    void registerClass(HsQMLClass*);
+    void unregisterClass(HsQMLClass*);
+    void setMetaCallProfiling(bool);
+    bool profileMetaCalls() const { return mProfileMetaCalls.load(); }
+    void reportMetaCalls(HsQMLMetaCallStatsCb);
+    bool markStartup(HsQMLStartupPhase);
+    int getStartupTimeline(qint64*, int);
     void hookedConstruct(QVariant::Private*, const void*);
     void hookedClear(QVariant::Private*);
     bool isEventThread();
     typedef HsQMLEventLoopStatus EventLoopStatus;
     EventLoopStatus runEventLoop(
-        HsQMLTrivialCb, HsQMLTrivialCb, HsQMLTrivialCb);
+        HsQMLTrivialCb, HsQMLJobsCb, HsQMLTrivialCb);
     EventLoopStatus requireEventLoop();
     void releaseEventLoop();
-    void notifyJobs();
+    void postJob(HsStablePtr, HsQMLJobPriority);
+    void wakeJobs(HsQMLJobPriority, bool = false);
+    void runJobs(HsQMLJobPriority);
+    bool requestJobsFrame();
+    void runFrameJobs();
+    void setJobBudget(int);
+    int jobBacklog();
     void setActiveEngine(HsQMLEngine*);
     HsQMLEngine* activeEngine();
     void postAppEvent(QEvent*);
     void zombifyClass(HsQMLClass*);
+    HsQMLClass* reviveClass(const unsigned int*, const unsigned int*,
+        const char*);
+    int getZombieStats(qint64*, int);
     EventLoopStatus shutdown();
     void setWindowIcon(const QString& iconPath);
 
@@ -71,28 +112,54 @@ private:
     friend class HsQMLManagerApp;
     Q_DISABLE_COPY(HsQMLManager)
 
+    enum LoopState {LoopIdle, LoopActive, LoopShutdown};
+    enum {RunFlag = 1, RunRef = 2};
+
+    LoopState enterLoopState(LoopState);
+    bool acquireRun();
+    void releaseRun();
+    void drainJobs(HsQMLJobPriority);
+    void queueFrees();
+
     int mLogLevel;
-    QMutex mLogLock;
+    HsQMLLogWriter mLogWriter;
+    QScopedPointer<HsQMLTracer> mTracer;
+    HsQMLStallProfiler mStallProfiler;
     QAtomicInt mCounters[TotalCounters];
     bool mAtExit;
     void (*mFreeFun)(HsFunPtr);
     void (*mFreeStable)(HsStablePtr);
+    QVector<HsFunPtr> mPendingFuns;
+    QVector<HsStablePtr> mPendingStables;
+    bool mFreesPosted;
     QVector<QByteArray> mArgs;
     QVector<char*> mArgsPtrs;
-    QSet<const QObject*> mObjectSet;
-    QVector<HsQMLClass*> mZombieClasses;
+    HsQMLObjectSet mObjectSet;
+    QMutex mStartupLock;
+    qint64 mStartupTimes[StartupPhases];
+    QMutex mClassLock;
+    QVector<HsQMLClass*> mClasses;
+    QAtomicInt mProfileMetaCalls;
+    QMultiHash<uint, HsQMLClass*> mZombieClasses;
+    int mZombieRevivals;
     const QVariant::Handler* mOriginalHandler;
     HsQMLManagerApp* mApp;
-    QMutex mLock;
+    QAtomicInt mLoopState;
+    QAtomicInt mRunState;
     bool mRunning;
-    int mRunCount;
-    bool mShutdown;
     void* mStackBase;
     HsQMLTrivialCb mStartCb;
-    HsQMLTrivialCb mJobsCb;
+    HsQMLJobsCb mJobsCb;
+    HsQMLJobQueue mJobQueues[JobLanes];
+    QAtomicInt mJobsWakeup[JobLanes];
+    QAtomicInt mJobBudget;
+    QAtomicInt mJobBacklog;
     HsQMLTrivialCb mYieldCb;
     HsQMLEngine* mActiveEngine;
     bool mQmlDebugEnabled;
+    bool mFrameSyncJobs;
+    bool mGuiApplication;
+    bool mCoreApplication;
 };
 
 class HsQMLManagerApp : public QObject
@@ -106,6 +173,11 @@ public:
     virtual void timerEvent(QTimerEvent*);
     virtual void setWindowIcon(QIcon*);
     int exec();
+    void startYield();
+    void stopYield();
+    void wakeYield();
+    void startFrameTimeout();
+    void stopFrameTimeout();
 
     enum CustomEventIndicies {
         StartedLoopEventIndex,
@@ -113,6 +185,8 @@ public:
         PendingJobsEventIndex,
         RemoveGCLockEventIndex,
         CreateEngineEventIndex,
+        WakeYieldEventIndex,
+        FreeEventIndex,
     };
 
     static const QEvent::Type StartedLoopEvent =
@@ -125,13 +199,36 @@ public:
         static_cast<QEvent::Type>(QEvent::User+RemoveGCLockEventIndex);
     static const QEvent::Type CreateEngineEvent =
         static_cast<QEvent::Type>(QEvent::User+CreateEngineEventIndex);
+    static const QEvent::Type WakeYieldEvent =
+        static_cast<QEvent::Type>(QEvent::User+WakeYieldEventIndex);
+    static const QEvent::Type FreeEvent =
+        static_cast<QEvent::Type>(QEvent::User+FreeEventIndex);
 
 private:
     Q_DISABLE_COPY(HsQMLManagerApp)
 
+    void runYield();
+    Q_SLOT void yieldNotified();
+
+    QBasicTimer mYieldTimer;
+    QBasicTimer mFrameTimer;
+    int mYieldInterval;
+    QAtomicInt mYieldIdle;
+    int mYieldFds[2];
+    QScopedPointer<QSocketNotifier> mYieldNotifier;
     QVariant::Handler mHookedHandler;
     int mArgC;
-    QApplication mApp;
+    QScopedPointer<QCoreApplication> mApp;
+};
+
+class HsQMLJobsEvent : public QEvent
+{
+public:
+    HsQMLJobsEvent(HsQMLJobPriority);
+    HsQMLJobPriority priority() const;
+
+private:
+    HsQMLJobPriority mPriority;
 };
 
 class ManagerPointer : public QAtomicPointer<HsQMLManager>
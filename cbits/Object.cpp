@@ -1,17 +1,73 @@
 #include <HsFFI.h>
-#include <QtCore/QString>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEvent>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QMutexLocker>
+#include <QtCore/QString>
+#include <QtCore/QVarLengthArray>
 #include <QtQml/QQmlEngine>
 
 #include "Object.h"
 #include "Class.h"
 #include "Engine.h"
 #include "Manager.h"
+#include "Pool.h"
 
 static const char* cRefSrcNames[] = {
     "Hndl", "Weak", "Eng", "Var", "Obj", "Event"
 };
 
+static QByteArray trace_member_name(
+    HsQMLClass* klass, QMetaObject::Call c, int id)
+{
+    const QMetaObject* mo = klass->metaObj();
+    QByteArray name(klass->name());
+    name += "::";
+    if (QMetaObject::InvokeMetaMethod == c) {
+        name += mo->method(mo->methodOffset()+id).name();
+    }
+    else {
+        name += mo->property(mo->propertyOffset()+id).name();
+    }
+    return name;
+}
+
+// Objects are churned in large numbers by models, so they are allocated from
+// pools to avoid the cost of malloc and fragmenting the heap.
+static HsQMLPool gProxyPool(
+    sizeof(HsQMLObjectProxy), Q_ALIGNOF(HsQMLObjectProxy));
+static HsQMLPool gObjectPool(sizeof(HsQMLObject), Q_ALIGNOF(HsQMLObject));
+
+// Packing of the proxy reference count, where both halves change together
+static const qint64 cRefOne = 1;
+static const qint64 cStrongRefOne = Q_INT64_C(1) << 32;
+static const qint64 cRefMask = cStrongRefOne-1;
+
+// Finalisers are only added to a few objects, so they are kept in a table
+// rather than every proxy carrying storage and a lock for them.
+typedef QVarLengthArray<HsQMLObjectFinaliser::Ref, 1> Finalisers;
+static QMutex gFinaliseLock;
+static QHash<const HsQMLObjectProxy*, Finalisers> gFinalisers;
+
+// Proxies waiting for the event loop to remove their GC locks. Any thread can
+// push onto the list, and the event loop takes the whole list at once, so a
+// single event is posted for each batch.
+struct HsQMLUnlockNode
+{
+    HsQMLObjectProxy* mProxy;
+    HsQMLUnlockNode* mNext;
+};
+static HsQMLPool gUnlockPool(
+    sizeof(HsQMLUnlockNode), Q_ALIGNOF(HsQMLUnlockNode));
+static QAtomicPointer<HsQMLUnlockNode> gUnlockList;
+
+#if QT_POINTER_SIZE == 8
+Q_STATIC_ASSERT(sizeof(HsQMLObjectProxy) == 40);
+Q_STATIC_ASSERT(sizeof(HsQMLObject) == 56);
+#endif
+
 static bool isStrongRef(HsQMLObjectProxy::RefSrc src)
 {
     return src == HsQMLObjectProxy::Handle ||
@@ -30,15 +86,17 @@ HsQMLObjectFinaliser::~HsQMLObjectFinaliser()
 
 void HsQMLObjectFinaliser::finalise(HsQMLObjectProxy* proxy) const
 {
+    HsQMLStallScope stall(gManager->stallProfiler(), HSQML_STALL_FINALISER);
     mFinaliseCb(reinterpret_cast<HsQMLObjectHandle*>(proxy));
 }
 
 HsQMLObjectProxy::HsQMLObjectProxy(HsStablePtr haskell, HsQMLClass* klass)
     : mHaskell(haskell)
     , mKlass(klass)
-    , mSerial(gManager->updateCounter(HsQMLManager::ObjectSerial, 1))
-    , mObject(NULL)
+    , mObjects(NULL)
     , mRefCount(0)
+    , mSerial(gManager->updateCounter(HsQMLManager::ObjectSerial, 1))
+    , mFlags(0)
 {
     ref(Handle);
     mKlass->ref(HsQMLClass::ObjProxy);
@@ -47,11 +105,26 @@ HsQMLObjectProxy::HsQMLObjectProxy(HsStablePtr haskell, HsQMLClass* klass)
 
 HsQMLObjectProxy::~HsQMLObjectProxy()
 {
+    if (mFlags.loadAcquire() & FinalisersFlag) {
+        QMutexLocker locker(&gFinaliseLock);
+        gFinalisers.remove(this);
+    }
     mKlass->deref(HsQMLClass::ObjProxy);
     gManager->updateCounter(HsQMLManager::ObjectCount, -1);
     gManager->freeStable(mHaskell);
 }
 
+void* HsQMLObjectProxy::operator new(size_t size)
+{
+    Q_ASSERT(size <= gProxyPool.blockSize());
+    return gProxyPool.alloc();
+}
+
+void HsQMLObjectProxy::operator delete(void* ptr)
+{
+    gProxyPool.free(ptr);
+}
+
 HsStablePtr HsQMLObjectProxy::haskell() const
 {
     return mHaskell;
@@ -66,43 +139,77 @@ HsQMLObject* HsQMLObjectProxy::object(HsQMLEngine* engine)
 {
     Q_ASSERT(gManager->isEventThread());
     Q_ASSERT(engine);
-    if (!mObject) {
-        mObject = new HsQMLObject(this, engine);
-
-        HSQML_LOG(5,
-            QString().asprintf("New QObject, class=%s, id=%d, qptr=%p.",
-            mKlass->name(), mSerial, mObject));
+    HsQMLObject* obj = findObject(engine);
+    if (!obj) {
+        obj = new HsQMLObject(this, engine);
+        obj->mNext = mObjects;
+        mObjects = obj;
+
+        HSQML_LOG_EVENT(5, HsQMLLogRecord::QObjectRecord,
+            "New", mKlass->name(), mSerial, NULL, 0, obj);
     }
 
     // Old objects may have lost their lock via weak references in addition
     // to new objects needing it.
     tryGCLock();
 
-    return mObject;
+    return obj;
 }
 
-void HsQMLObjectProxy::clearObject()
+HsQMLObject* HsQMLObjectProxy::findObject(HsQMLEngine* engine) const
+{
+    for (HsQMLObject* obj = mObjects; obj; obj = obj->mNext) {
+        if (obj->engine() == engine) {
+            return obj;
+        }
+    }
+    return NULL;
+}
+
+int HsQMLObjectProxy::engines(HsQMLEngine** engines, int count) const
+{
+    int n = 0;
+    for (HsQMLObject* obj = mObjects; obj; obj = obj->mNext, n++) {
+        if (n < count) {
+            engines[n] = obj->engine();
+        }
+    }
+    return n;
+}
+
+void HsQMLObjectProxy::clearObject(HsQMLObject* obj)
 {
     Q_ASSERT(gManager->isEventThread());
 
-    HSQML_LOG(5,
-        QString().asprintf("Release QObject, class=%s, id=%d, qptr=%p.",
-        mKlass->name(), mSerial, mObject));
+    HSQML_LOG_EVENT(5, HsQMLLogRecord::QObjectRecord,
+        "Release", mKlass->name(), mSerial, NULL, 0, obj);
+
+    HsQMLObject* volatile* link = &mObjects;
+    while (*link != obj) {
+        link = &(*link)->mNext;
+    }
+    *link = obj->mNext;
 
-    mObject = NULL;
-    runFinalisers();
+    // Finalisers wait until the object has gone from every engine
+    if (!mObjects) {
+        runFinalisers();
+    }
 }
 
 void HsQMLObjectProxy::tryGCLock()
 {
     Q_ASSERT(gManager->isEventThread());
 
-    if (mObject && mStrongCount.loadAcquire() > 0 && !mObject->isGCLocked()) {
-        mObject->setGCLock();
+    if (strongCount() == 0) {
+        return;
+    }
+    for (HsQMLObject* obj = mObjects; obj; obj = obj->mNext) {
+        if (!obj->isGCLocked()) {
+            obj->setGCLock();
 
-        HSQML_LOG(5,
-            QString().asprintf("Lock QObject, class=%s, id=%d, qptr=%p.",
-            mKlass->name(), mSerial, mObject));
+            HSQML_LOG_EVENT(5, HsQMLLogRecord::QObjectRecord,
+                "Lock", mKlass->name(), mSerial, NULL, 0, obj);
+        }
     }
 }
 
@@ -110,15 +217,18 @@ void HsQMLObjectProxy::removeGCLock()
 {
     Q_ASSERT(gManager->isEventThread());
 
-    if (mObject && mStrongCount.loadAcquire() == 0) {
-        if (mObject->isGCLocked()) {
-            mObject->clearGCLock();
+    if (mObjects && strongCount() == 0) {
+        bool locked = false;
+        for (HsQMLObject* obj = mObjects; obj; obj = obj->mNext) {
+            if (obj->isGCLocked()) {
+                obj->clearGCLock();
+                locked = true;
 
-            HSQML_LOG(5,
-                QString().asprintf("Unlock QObject, class=%s, id=%d, qptr=%p.",
-                mKlass->name(), mSerial, mObject));
+                HSQML_LOG_EVENT(5, HsQMLLogRecord::QObjectRecord,
+                    "Unlock", mKlass->name(), mSerial, NULL, 0, obj);
+            }
         }
-        else {
+        if (!locked) {
             // If there had been a QML object then this would have happened
             // when the QML GC collected it.
             runFinalisers();
@@ -126,19 +236,67 @@ void HsQMLObjectProxy::removeGCLock()
     }
 }
 
+void HsQMLObjectProxy::queueGCUnlock()
+{
+    // A proxy only needs to be queued once until the queue is processed
+    if (mFlags.fetchAndOrOrdered(UnlockPendingFlag) & UnlockPendingFlag) {
+        return;
+    }
+    ref(Event);
+
+    HsQMLUnlockNode* node =
+        static_cast<HsQMLUnlockNode*>(gUnlockPool.alloc());
+    node->mProxy = this;
+    HsQMLUnlockNode* head;
+    do {
+        head = gUnlockList.loadAcquire();
+        node->mNext = head;
+    } while (!gUnlockList.testAndSetOrdered(head, node));
+
+    // Only the push onto an empty list needs to wake the event loop
+    if (!head) {
+        gManager->postAppEvent(new QEvent(HsQMLManagerApp::RemoveGCLockEvent));
+    }
+}
+
+int HsQMLObjectProxy::removePendingGCLocks()
+{
+    Q_ASSERT(gManager->isEventThread());
+
+    int count = 0;
+    HsQMLUnlockNode* node = gUnlockList.fetchAndStoreOrdered(NULL);
+    while (node) {
+        HsQMLObjectProxy* proxy = node->mProxy;
+        HsQMLUnlockNode* next = node->mNext;
+        gUnlockPool.free(node);
+        node = next;
+
+        proxy->mFlags.fetchAndAndOrdered(~UnlockPendingFlag);
+        proxy->removeGCLock();
+        proxy->deref(Event);
+        count++;
+    }
+    return count;
+}
+
 void HsQMLObjectProxy::addFinaliser(const HsQMLObjectFinaliser::Ref& f)
 {
-    QMutexLocker locker(&mFinaliseMutex);
-    mFinalisers.append(f);
+    QMutexLocker locker(&gFinaliseLock);
+    gFinalisers[this].append(f);
+    mFlags.fetchAndOrOrdered(FinalisersFlag);
 }
 
 void HsQMLObjectProxy::runFinalisers()
 {
-    // Copy and clear finalisers under lock
-    mFinaliseMutex.lock();
-    const Finalisers fs = mFinalisers;
-    mFinalisers.clear();
-    mFinaliseMutex.unlock();
+    if (!(mFlags.loadAcquire() & FinalisersFlag)) {
+        return;
+    }
+
+    // Take finalisers under lock
+    gFinaliseLock.lock();
+    const Finalisers fs = gFinalisers.take(this);
+    mFlags.fetchAndAndOrdered(~FinalisersFlag);
+    gFinaliseLock.unlock();
 
     // Call finalisers outside lock so they can re-addFinaliser()
     Q_FOREACH(const HsQMLObjectFinaliser::Ref& f, fs) {
@@ -149,37 +307,42 @@ void HsQMLObjectProxy::runFinalisers()
 
 HsQMLEngine* HsQMLObjectProxy::engine() const
 {
-    if (mObject != NULL) {
-        return mObject->engine();
+    // The engine which the object was most recently marshalled to
+    HsQMLObject* obj = mObjects;
+    if (obj != NULL) {
+        return obj->engine();
     }
     return NULL;
 }
 
+int HsQMLObjectProxy::strongCount() const
+{
+    return static_cast<int>(mRefCount.loadAcquire() >> 32);
+}
+
 void HsQMLObjectProxy::ref(RefSrc src)
 {
-    int count = mRefCount.fetchAndAddOrdered(1);
+    qint64 counts = mRefCount.fetchAndAddOrdered(
+        isStrongRef(src) ? cRefOne+cStrongRefOne : cRefOne);
+    int count = static_cast<int>(counts & cRefMask);
 
-    HSQML_LOG(count == 0 ? 3 : 4,
-        QString().asprintf("%s ObjProxy, class=%s, id=%d, src=%s, count=%d.",
+    HSQML_LOG_EVENT(count == 0 ? 3 : 4, HsQMLLogRecord::ObjProxyRecord,
         count ? "Ref" : "New", mKlass->name(),
-        mSerial, cRefSrcNames[src], count+1));
-
-    if (isStrongRef(src)) {
-        mStrongCount.fetchAndAddOrdered(1);
-    }
+        mSerial, cRefSrcNames[src], count+1);
 }
 
 void HsQMLObjectProxy::deref(RefSrc src)
 {
-    // Remove JavaScript GC lock when there are no strong handles
+    // Remove JavaScript GC lock when there are no strong handles. This must
+    // happen before the reference is released, which could delete the proxy.
     if (isStrongRef(src)) {
-        int strongCount = mStrongCount.fetchAndAddOrdered(-1);
-        if (strongCount == 1 && mObject) {
+        qint64 counts = mRefCount.fetchAndAddOrdered(-cStrongRefOne);
+        if ((counts >> 32) == 1 && mObjects) {
             if (src == Handle) {
-                // Handles can be dereferenced from any thread. The event will
-                // remove the lock if there are still no handles by the time
-                // it reaches the event loop.
-                gManager->postAppEvent(new HsQMLObjectEvent(this));
+                // Handles can be dereferenced from any thread. The event loop
+                // will remove the lock if there are still no handles by the
+                // time it processes the queue.
+                queueGCUnlock();
             }
             else {
                 removeGCLock();
@@ -187,41 +350,23 @@ void HsQMLObjectProxy::deref(RefSrc src)
         }
     }
 
-    int count = mRefCount.fetchAndAddOrdered(-1);
+    qint64 counts = mRefCount.fetchAndAddOrdered(-cRefOne);
+    int count = static_cast<int>(counts & cRefMask);
 
-    HSQML_LOG(count == 1 ? 3 : 4,
-        QString().asprintf("%s ObjProxy, class=%s, id=%d, src=%s, count=%d.",
+    HSQML_LOG_EVENT(count == 1 ? 3 : 4, HsQMLLogRecord::ObjProxyRecord,
         count > 1 ? "Deref" : "Delete", mKlass->name(),
-        mSerial, cRefSrcNames[src], count));
+        mSerial, cRefSrcNames[src], count);
 
     if (count == 1) {
         delete this;
     }
 }
 
-HsQMLObjectEvent::HsQMLObjectEvent(HsQMLObjectProxy* proxy)
-    : QEvent(HsQMLManagerApp::RemoveGCLockEvent)
-    , mProxy(proxy)
-{
-    mProxy->ref(HsQMLObjectProxy::Event);
-}
-
-HsQMLObjectEvent::~HsQMLObjectEvent()
-{
-    mProxy->deref(HsQMLObjectProxy::Event);
-}
-
-void HsQMLObjectEvent::process()
-{
-    Q_ASSERT(type() == HsQMLManagerApp::RemoveGCLockEvent);
-    mProxy->removeGCLock();
-}
-
 HsQMLObject::HsQMLObject(HsQMLObjectProxy* proxy, HsQMLEngine* engine)
     : mProxy(proxy)
-    , mHaskell(proxy->haskell())
     , mKlass(proxy->klass())
     , mEngine(engine)
+    , mNext(NULL)
 {
     QQmlEngine::setObjectOwnership(
         this, QQmlEngine::JavaScriptOwnership);
@@ -232,12 +377,25 @@ HsQMLObject::HsQMLObject(HsQMLObjectProxy* proxy, HsQMLEngine* engine)
 
 HsQMLObject::~HsQMLObject()
 {
-    mProxy->clearObject();
+    // Objects can be deleted from QML while their release is pending
+    mEngine->cancelGCRelease(this);
+    mProxy->clearObject(this);
     mProxy->deref(HsQMLObjectProxy::Object);
     gManager->unregisterObject(this);
     gManager->updateCounter(HsQMLManager::QObjectCount, -1);
 }
 
+void* HsQMLObject::operator new(size_t size)
+{
+    Q_ASSERT(size <= gObjectPool.blockSize());
+    return gObjectPool.alloc();
+}
+
+void HsQMLObject::operator delete(void* ptr)
+{
+    gObjectPool.free(ptr);
+}
+
 const QMetaObject* HsQMLObject::metaObject() const
 {
     return QObject::d_ptr->metaObject ?
@@ -261,6 +419,25 @@ int HsQMLObject::qt_metacall(QMetaObject::Call c, int id, void** a)
     if (id < 0) {
         return id;
     }
+
+    // Invoking methods and reading or writing properties are the first three
+    // call types and the only ones which run Haskell code.
+    bool haskellCall = c <= QMetaObject::WriteProperty;
+    HsQMLTraceSpan span(haskellCall ? gManager->tracer() : NULL, "metacall");
+    if (span.isActive()) {
+        span.setName(trace_member_name(mKlass, c, id));
+    }
+    QElapsedTimer timer;
+    bool profile = haskellCall && gManager->profileMetaCalls();
+    if (profile) {
+        timer.start();
+    }
+    int member = id;
+
+    // The stall sites for calls are in the same order as the call types
+    HsQMLStallScope stall(haskellCall ? gManager->stallProfiler() : NULL,
+        static_cast<HsQMLStallSite>(HSQML_STALL_METHOD + c));
+
     gManager->setActiveEngine(mEngine);
     if (QMetaObject::InvokeMetaMethod == c) {
         mKlass->methods()[id](this, a);
@@ -285,27 +462,40 @@ int HsQMLObject::qt_metacall(QMetaObject::Call c, int id, void** a)
         id -= mKlass->propertyCount();
     }
     gManager->setActiveEngine(NULL);
+    if (profile) {
+        mKlass->recordMetaCall(c, member, timer.nsecsElapsed());
+    }
     return id;
 }
 
 void HsQMLObject::setGCLock()
 {
-    mGCLock = mEngine->declEngine()->newQObject(this);
+    mJSValue = mEngine->declEngine()->newQObject(this);
 }
 
 void HsQMLObject::clearGCLock()
 {
-    mGCLock = QJSValue(QJSValue::NullValue);
+    // The wrapper is kept until the engine releases it later, so objects
+    // which are locked again before then reuse it without calling into the
+    // JavaScript engine.
+    mEngine->releaseGCLockLater(this);
+}
+
+void HsQMLObject::releaseGCLock()
+{
+    if (mProxy->strongCount() == 0) {
+        mJSValue = QJSValue(QJSValue::NullValue);
+    }
 }
 
 bool HsQMLObject::isGCLocked() const
 {
-    return mGCLock.isQObject();
+    return mJSValue.isQObject();
 }
 
-QJSValue* HsQMLObject::gcLockVar()
+QJSValue* HsQMLObject::jsValue()
 {
-    return &mGCLock;
+    return &mJSValue;
 }
 
 HsQMLObjectProxy* HsQMLObject::proxy() const
@@ -346,6 +536,27 @@ extern "C" int hsqml_object_set_active(
     return true;
 }
 
+extern "C" int hsqml_object_get_engines(
+    HsQMLObjectHandle* hndl, void** engines, int count)
+{
+    HsQMLObjectProxy* proxy = (HsQMLObjectProxy*)hndl;
+    return proxy->engines(reinterpret_cast<HsQMLEngine**>(engines), count);
+}
+
+extern "C" int hsqml_object_set_active_engine(
+    HsQMLObjectHandle* hndl, void* ptr)
+{
+    // The engine is only compared against the object's instances, so it can
+    // be one which has since been deleted.
+    HsQMLObjectProxy* proxy = (HsQMLObjectProxy*)hndl;
+    HsQMLEngine* engine = static_cast<HsQMLEngine*>(ptr);
+    if (proxy->findObject(engine)) {
+        gManager->setActiveEngine(engine);
+        return true;
+    }
+    return false;
+}
+
 extern "C" HsStablePtr hsqml_object_get_hs_typerep(
     HsQMLObjectHandle* hndl)
 {
@@ -372,7 +583,7 @@ extern HsQMLJValHandle* hsqml_object_get_jval(
 {
     HsQMLObjectProxy* proxy = reinterpret_cast<HsQMLObjectProxy*>(hndl);
     HsQMLObject* obj = proxy->object(gManager->activeEngine());
-    return reinterpret_cast<HsQMLJValHandle*>(obj->gcLockVar());
+    return reinterpret_cast<HsQMLJValHandle*>(obj->jsValue());
 }
 
 extern HsQMLObjectHandle* hsqml_get_object_from_pointer(
@@ -429,13 +640,14 @@ extern void hsqml_fire_signal(
     HsQMLObjectHandle* hndl, int idx, void** args)
 {
     HsQMLObjectProxy* proxy = (HsQMLObjectProxy*)hndl;
-    HsQMLEngine* engine = proxy->engine();
+    // Fires on the instance for the active engine. Arguments are marshalled
+    // for that engine, so callers fire once per instance to reach them all.
+    HsQMLEngine* engine = gManager->activeEngine();
+    HsQMLObject* obj = engine ? proxy->findObject(engine) : NULL;
     // Ignore objects which haven't been marshalled as they are not connected.
-    if (engine) {
+    if (obj) {
         // Clear active engine in case the slot code calls back into Haskell.
-        Q_ASSERT(gManager->activeEngine() == engine);
         gManager->setActiveEngine(NULL);
-        HsQMLObject* obj = proxy->object(engine);
         QMetaObject::activate(obj, proxy->klass()->metaObj(), idx, args);
     }
 }
@@ -461,3 +673,16 @@ extern void hsqml_object_add_finaliser(
     HsQMLObjectProxy* proxy = reinterpret_cast<HsQMLObjectProxy*>(hndl);
     proxy->addFinaliser(*reinterpret_cast<HsQMLObjectFinaliser::Ref*>(fhndl));
 }
+
+extern int hsqml_get_pool_stats(
+    HsQMLPoolId pool, long long* values, int count)
+{
+    switch (pool) {
+    case HSQML_POOL_OBJ_PROXY:
+        return gProxyPool.stats(values, count);
+    case HSQML_POOL_QOBJECT:
+        return gObjectPool.stats(values, count);
+    default:
+        return 0;
+    }
+}
@@ -3,10 +3,8 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QAtomicInt>
-#include <QtCore/QEvent>
+#include <QtCore/QAtomicInteger>
 #include <QtCore/QExplicitlySharedDataPointer>
-#include <QtCore/QMutex>
-#include <QtCore/QVarLengthArray>
 #include <QtQml/QJSValue>
 
 #include "hsqml.h"
@@ -31,20 +29,30 @@ private:
     HsQMLObjFinaliserCb mFinaliseCb;
 };
 
+// Links a Haskell object to the QObject which represents it in QML. Proxies
+// are created for every object passed to QML, so they are kept small. On
+// 64-bit platforms a proxy is 40 bytes, down from 80 with a vtable, a mutex
+// and inline storage for finalisers which most objects never have.
 class HsQMLObjectProxy
 {
 public:
     HsQMLObjectProxy(HsStablePtr, HsQMLClass*);
-    virtual ~HsQMLObjectProxy();
+    ~HsQMLObjectProxy();
+    static void* operator new(size_t);
+    static void operator delete(void*);
     HsStablePtr haskell() const;
     HsQMLClass* klass() const;
     HsQMLObject* object(HsQMLEngine*);
-    void clearObject();
+    HsQMLObject* findObject(HsQMLEngine*) const;
+    int engines(HsQMLEngine**, int) const;
+    void clearObject(HsQMLObject*);
     void tryGCLock();
     void removeGCLock();
+    static int removePendingGCLocks();
     void addFinaliser(const HsQMLObjectFinaliser::Ref&);
     void runFinalisers();
     HsQMLEngine* engine() const;
+    int strongCount() const;
     enum RefSrc {Handle, WeakHandle, Engine, Variant, Object, Event};
     void ref(RefSrc);
     void deref(RefSrc);
@@ -52,51 +60,52 @@ public:
 private:
     Q_DISABLE_COPY(HsQMLObjectProxy);
 
+    enum Flags {FinalisersFlag = 1, UnlockPendingFlag = 2};
+
+    void queueGCUnlock();
+
     HsStablePtr mHaskell;
     HsQMLClass* mKlass;
+    // Instances for each engine, linked through the objects themselves
+    HsQMLObject* volatile mObjects;
+    // Counts all references in the low half and strong ones in the high half
+    QAtomicInteger<qint64> mRefCount;
     int mSerial;
-    HsQMLObject* volatile mObject;
-    QAtomicInt mRefCount;
-    QAtomicInt mStrongCount;
-    QMutex mFinaliseMutex;
-    typedef QVarLengthArray<HsQMLObjectFinaliser::Ref, 1> Finalisers;
-    Finalisers mFinalisers;
-};
-
-class HsQMLObjectEvent : public QEvent
-{
-public:
-    HsQMLObjectEvent(HsQMLObjectProxy*);
-    virtual ~HsQMLObjectEvent();
-    void process();
-
-private:
-    HsQMLObjectProxy* mProxy;
+    // Finalisers are kept in a table outside of the proxy, see Flags
+    QAtomicInt mFlags;
 };
 
+// QObject which represents a proxy to one engine, which is 56 bytes on 64-bit
+// platforms in addition to the QObject's private data. A proxy marshalled to
+// several engines has a separate instance for each one.
 class HsQMLObject : public QObject
 {
 public:
     HsQMLObject(HsQMLObjectProxy*, HsQMLEngine*);
     virtual ~HsQMLObject();
+    static void* operator new(size_t);
+    static void operator delete(void*);
     virtual const QMetaObject* metaObject() const;
     virtual void* qt_metacast(const char*);
     virtual int qt_metacall(QMetaObject::Call, int, void**);
     void setGCLock();
     void clearGCLock();
+    void releaseGCLock();
     bool isGCLocked() const;
-    QJSValue* gcLockVar();
+    QJSValue* jsValue();
     HsQMLObjectProxy* proxy() const;
     HsQMLEngine* engine() const;
 
 private:
     Q_DISABLE_COPY(HsQMLObject);
+    friend class HsQMLObjectProxy;
 
     HsQMLObjectProxy* mProxy;
-    HsStablePtr mHaskell;
     HsQMLClass* mKlass;
     HsQMLEngine* mEngine;
-    QJSValue mGCLock;
+    HsQMLObject* mNext;
+    // Strong reference to the JavaScript wrapper, which is the GC lock
+    QJSValue mJSValue;
 };
 
 #endif /*HSQML_OBJECT_H*/
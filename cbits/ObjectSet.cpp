@@ -0,0 +1,101 @@
+#include <cstring>
+
+#include "ObjectSet.h"
+
+static const int cInitialBits = 6;
+
+HsQMLObjectSet::HsQMLObjectSet()
+    : mSlots(NULL)
+    , mMask(0)
+    , mShift(0)
+    , mSize(0)
+{
+    rehash(cInitialBits);
+}
+
+HsQMLObjectSet::~HsQMLObjectSet()
+{
+    delete[] mSlots;
+}
+
+void HsQMLObjectSet::insert(const QObject* obj)
+{
+    Q_ASSERT(obj);
+
+    // Keep the load factor at or below one half
+    if (2*(mSize+1) > static_cast<int>(mMask+1)) {
+        rehash(64-mShift+1);
+    }
+
+    quintptr i = index(obj);
+    while (mSlots[i]) {
+        if (mSlots[i] == obj) {
+            return;
+        }
+        i = (i+1) & mMask;
+    }
+    mSlots[i] = obj;
+    mSize++;
+}
+
+bool HsQMLObjectSet::remove(const QObject* obj)
+{
+    quintptr i = index(obj);
+    while (mSlots[i] != obj) {
+        if (!mSlots[i]) {
+            return false;
+        }
+        i = (i+1) & mMask;
+    }
+
+    // Shift later members of the probe sequence back into the gap so that
+    // no tombstones are needed.
+    quintptr j = i;
+    for (;;) {
+        mSlots[i] = NULL;
+        for (;;) {
+            j = (j+1) & mMask;
+            if (!mSlots[j]) {
+                mSize--;
+                return true;
+            }
+            quintptr k = index(mSlots[j]);
+            // Stop if the home slot k lies cyclically outside (i, j]
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+                continue;
+            }
+            break;
+        }
+        mSlots[i] = mSlots[j];
+        i = j;
+    }
+}
+
+int HsQMLObjectSet::size() const
+{
+    return mSize;
+}
+
+void HsQMLObjectSet::rehash(int bits)
+{
+    const QObject** oldSlots = mSlots;
+    quintptr oldCount = oldSlots ? mMask+1 : 0;
+
+    quintptr count = static_cast<quintptr>(1) << bits;
+    mSlots = new const QObject*[count];
+    std::memset(mSlots, 0, count*sizeof(const QObject*));
+    mMask = count-1;
+    mShift = 64-bits;
+
+    for (quintptr n=0; n<oldCount; n++) {
+        const QObject* obj = oldSlots[n];
+        if (obj) {
+            quintptr i = index(obj);
+            while (mSlots[i]) {
+                i = (i+1) & mMask;
+            }
+            mSlots[i] = obj;
+        }
+    }
+    delete[] oldSlots;
+}
@@ -0,0 +1,55 @@
+#ifndef HSQML_OBJECTSET_H
+#define HSQML_OBJECTSET_H
+
+#include <QtCore/QObject>
+
+// Open-addressing set of object pointers with linear probing. Membership
+// tests are made on every QVariant in the process, so this avoids the
+// bucket chasing and node allocation of QSet. Not thread-safe.
+class HsQMLObjectSet
+{
+public:
+    HsQMLObjectSet();
+    ~HsQMLObjectSet();
+    void insert(const QObject*);
+    bool remove(const QObject*);
+    int size() const;
+
+    bool contains(const QObject* obj) const
+    {
+        if (!obj) {
+            return false;
+        }
+        for (quintptr i = index(obj);; i = (i+1) & mMask) {
+            const QObject* slot = mSlots[i];
+            if (slot == obj) {
+                return true;
+            }
+            else if (!slot) {
+                return false;
+            }
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(HsQMLObjectSet)
+
+    quintptr index(const QObject* obj) const
+    {
+        // Fold the high bits down before multiplying, otherwise objects
+        // allocated at a regular stride cluster under linear probing.
+        quint64 key = static_cast<quint64>(reinterpret_cast<quintptr>(obj));
+        key ^= key >> 29;
+        return static_cast<quintptr>(
+            (key * Q_UINT64_C(0xBF58476D1CE4E5B9)) >> mShift);
+    }
+
+    void rehash(int);
+
+    const QObject** mSlots;
+    quintptr mMask;
+    int mShift;
+    int mSize;
+};
+
+#endif /*HSQML_OBJECTSET_H*/
@@ -0,0 +1,136 @@
+#include <cstdlib>
+#include <QtCore/QMutexLocker>
+
+#include "Pool.h"
+
+static QAtomicInt gPoolNext(0);
+
+struct HsQMLPoolCache
+{
+    HsQMLPoolCache()
+        : mPool(NULL)
+        , mHead(NULL)
+        , mCount(0)
+    {}
+
+    ~HsQMLPoolCache()
+    {
+        // Return the blocks cached by a thread when it exits
+        if (mPool) {
+            mPool->drain(*this, mCount);
+        }
+    }
+
+    HsQMLPool* mPool;
+    HsQMLPool::Block* mHead;
+    int mCount;
+};
+
+static thread_local HsQMLPoolCache gPoolCaches[HsQMLPool::MaxPools];
+
+// Blocks are rounded up to the alignment of the pooled class, which must be a
+// power of two, so that every block in a slab is aligned.
+static size_t block_size(size_t size, size_t align)
+{
+    align = qMax(align, Q_ALIGNOF(void*));
+    return (qMax(size, sizeof(void*))+align-1) & ~(align-1);
+}
+
+HsQMLPool::HsQMLPool(size_t size, size_t align)
+    : mIndex(gPoolNext.fetchAndAddRelaxed(1))
+    , mSize(block_size(size, align))
+    , mSlabBlocks(qMax(static_cast<int>(SlabSize/mSize), 1))
+    , mFree(NULL)
+    , mSlabCount(0)
+    , mInUse(0)
+{
+    Q_ASSERT(mIndex < MaxPools);
+}
+
+HsQMLPoolCache& HsQMLPool::cache()
+{
+    HsQMLPoolCache& cache = gPoolCaches[mIndex];
+    cache.mPool = this;
+    return cache;
+}
+
+void* HsQMLPool::alloc()
+{
+    HsQMLPoolCache& c = cache();
+    if (!c.mHead) {
+        fill(c);
+    }
+    Block* block = c.mHead;
+    c.mHead = block->mNext;
+    c.mCount--;
+    mInUse.fetchAndAddRelaxed(1);
+    return block;
+}
+
+void HsQMLPool::free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    HsQMLPoolCache& c = cache();
+    Block* block = static_cast<Block*>(ptr);
+    block->mNext = c.mHead;
+    c.mHead = block;
+    c.mCount++;
+    mInUse.fetchAndAddRelaxed(-1);
+
+    // Keep part of the cache so that alternating calls don't take the lock
+    if (c.mCount > CacheSize) {
+        drain(c, CacheBatch);
+    }
+}
+
+void HsQMLPool::fill(HsQMLPoolCache& c)
+{
+    QMutexLocker locker(&mLock);
+    if (!mFree) {
+        char* slab = static_cast<char*>(std::malloc(mSlabBlocks*mSize));
+        Q_CHECK_PTR(slab);
+        for (int i=mSlabBlocks-1; i>=0; i--) {
+            Block* block = reinterpret_cast<Block*>(slab + i*mSize);
+            block->mNext = mFree;
+            mFree = block;
+        }
+        mSlabCount++;
+    }
+    for (int i=0; i<CacheBatch && mFree; i++) {
+        Block* block = mFree;
+        mFree = block->mNext;
+        block->mNext = c.mHead;
+        c.mHead = block;
+        c.mCount++;
+    }
+}
+
+void HsQMLPool::drain(HsQMLPoolCache& c, int count)
+{
+    QMutexLocker locker(&mLock);
+    for (int i=0; i<count && c.mHead; i++) {
+        Block* block = c.mHead;
+        c.mHead = block->mNext;
+        c.mCount--;
+        block->mNext = mFree;
+        mFree = block;
+    }
+}
+
+int HsQMLPool::stats(qint64* values, int count)
+{
+    // Block size, slabs, bytes reserved, blocks in use, and free blocks
+    // including those cached by threads
+    QMutexLocker locker(&mLock);
+    qint64 blocks = mSlabCount*mSlabBlocks;
+    qint64 inUse = mInUse.loadAcquire();
+    qint64 stats[5] = {
+        static_cast<qint64>(mSize), mSlabCount,
+        blocks*static_cast<qint64>(mSize), inUse, blocks-inUse};
+    for (int i=0; i<5 && i<count; i++) {
+        values[i] = stats[i];
+    }
+    return 5;
+}
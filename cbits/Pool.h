@@ -0,0 +1,52 @@
+#ifndef HSQML_POOL_H
+#define HSQML_POOL_H
+
+#include <cstddef>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+
+struct HsQMLPoolCache;
+
+// Allocates fixed size blocks carved from slabs, which are kept for reuse
+// rather than returned to the system. Each thread keeps a small cache of free
+// blocks so that the lock is only taken to move blocks in batches. Safe to
+// use from any thread.
+class HsQMLPool
+{
+public:
+    HsQMLPool(size_t, size_t);
+    void* alloc();
+    void free(void*);
+    size_t blockSize() const { return mSize; }
+    int stats(qint64*, int);
+
+    enum {
+        MaxPools = 8,
+        CacheSize = 64,
+        CacheBatch = 32,
+        SlabSize = 64*1024
+    };
+
+private:
+    Q_DISABLE_COPY(HsQMLPool)
+    friend struct HsQMLPoolCache;
+
+    struct Block {
+        Block* mNext;
+    };
+
+    HsQMLPoolCache& cache();
+    void fill(HsQMLPoolCache&);
+    void drain(HsQMLPoolCache&, int);
+
+    int mIndex;
+    size_t mSize;
+    int mSlabBlocks;
+    QMutex mLock;
+    Block* mFree;
+    qint64 mSlabCount;
+    // Blocks handed out, updated outside the lock by alloc() and free()
+    QAtomicInt mInUse;
+};
+
+#endif /*HSQML_POOL_H*/
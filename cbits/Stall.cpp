@@ -0,0 +1,106 @@
+#include <chrono>
+#include <QtCore/QMutexLocker>
+
+#include "Stall.h"
+#include "Manager.h"
+
+static const char* cStallSiteNames[] = {
+    "method",
+    "property read",
+    "property write",
+    "jobs",
+    "start",
+    "yield",
+    "finaliser",
+    "canvas delegate",
+    "canvas setup",
+    "canvas sync",
+    "canvas paint",
+    "canvas cleanup",
+};
+
+HsQMLStallProfiler::HsQMLStallProfiler()
+    : mThreshold(0)
+{
+    setThreshold(0);
+}
+
+void HsQMLStallProfiler::setThreshold(int usecs)
+{
+    // Statistics are reset whenever the threshold changes
+    QMutexLocker locker(&mLock);
+    mThreshold.store(qMax(usecs, 0));
+    for (int i=0; i<SiteCount; i++) {
+        mCalls[i].store(0);
+        mSites[i].mStalls = 0;
+        mSites[i].mStallTime = 0;
+        mSites[i].mMaxTime = 0;
+    }
+    mWorst.clear();
+}
+
+qint64 HsQMLStallProfiler::now()
+{
+    // The steady clock is CLOCK_MONOTONIC on most platforms, as is GHC's
+    // monotonic clock, so stalls can be lined up with GC events.
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void HsQMLStallProfiler::record(HsQMLStallSite site, qint64 start)
+{
+    qint64 duration = now() - start;
+    mCalls[site].fetchAndAddRelaxed(1);
+    if (duration < static_cast<qint64>(mThreshold.load())*1000) {
+        return;
+    }
+
+    HSQML_LOG(1, QString().asprintf("Stalled in %s callback for %.3f ms.",
+        cStallSiteNames[site], duration/1000000.0));
+
+    QMutexLocker locker(&mLock);
+    SiteStats& stats = mSites[site];
+    stats.mStalls++;
+    stats.mStallTime += duration;
+    stats.mMaxTime = qMax(stats.mMaxTime, duration);
+
+    // Keep the worst stalls sorted longest first
+    if (mWorst.size() == WorstStalls) {
+        if (duration <= mWorst.last().mDuration) {
+            return;
+        }
+        mWorst.removeLast();
+    }
+    int i = mWorst.size();
+    while (i > 0 && mWorst[i-1].mDuration < duration) {
+        i--;
+    }
+    Stall stall = {site, start, duration};
+    mWorst.insert(i, stall);
+}
+
+int HsQMLStallProfiler::worstStalls(
+    int* sites, qint64* starts, qint64* durations, int max)
+{
+    QMutexLocker locker(&mLock);
+    int count = qMin(max, mWorst.size());
+    for (int i=0; i<count; i++) {
+        sites[i] = mWorst[i].mSite;
+        starts[i] = mWorst[i].mStart;
+        durations[i] = mWorst[i].mDuration;
+    }
+    return count;
+}
+
+int HsQMLStallProfiler::summary(qint64* values, int count)
+{
+    // Four values for each site: calls, stalls, total and maximum stall time
+    QMutexLocker locker(&mLock);
+    for (int i=0; i<SiteCount && 4*i+3<count; i++) {
+        values[4*i] = mCalls[i].load();
+        values[4*i+1] = mSites[i].mStalls;
+        values[4*i+2] = mSites[i].mStallTime;
+        values[4*i+3] = mSites[i].mMaxTime;
+    }
+    return SiteCount;
+}
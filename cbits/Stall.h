@@ -0,0 +1,72 @@
+#ifndef HSQML_STALL_H
+#define HSQML_STALL_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+#include "hsqml.h"
+
+// Measures how long Qt threads spend blocked in callbacks into Haskell and
+// keeps the worst calls which exceeded a threshold.
+class HsQMLStallProfiler
+{
+public:
+    HsQMLStallProfiler();
+    void setThreshold(int);
+    bool enabled() const { return mThreshold.load() > 0; }
+    static qint64 now();
+    void record(HsQMLStallSite, qint64);
+    int worstStalls(int*, qint64*, qint64*, int);
+    int summary(qint64*, int);
+
+    enum {WorstStalls = 32, SiteCount = HSQML_STALL_CANVAS_CLEANUP+1};
+
+private:
+    Q_DISABLE_COPY(HsQMLStallProfiler)
+
+    struct Stall {
+        HsQMLStallSite mSite;
+        qint64 mStart;
+        qint64 mDuration;
+    };
+    struct SiteStats {
+        qint64 mStalls;
+        qint64 mStallTime;
+        qint64 mMaxTime;
+    };
+
+    QAtomicInt mThreshold;
+    QAtomicInt mCalls[SiteCount];
+    QMutex mLock;
+    SiteStats mSites[SiteCount];
+    QVector<Stall> mWorst;
+};
+
+// Times the enclosing scope as a callback into Haskell if the profiler is
+// not NULL.
+class HsQMLStallScope
+{
+public:
+    HsQMLStallScope(HsQMLStallProfiler* profiler, HsQMLStallSite site)
+        : mProfiler(profiler)
+        , mSite(site)
+        , mStart(profiler ? HsQMLStallProfiler::now() : 0)
+    {}
+
+    ~HsQMLStallScope()
+    {
+        if (mProfiler) {
+            mProfiler->record(mSite, mStart);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(HsQMLStallScope)
+
+    HsQMLStallProfiler* mProfiler;
+    HsQMLStallSite mSite;
+    qint64 mStart;
+};
+
+#endif /*HSQML_STALL_H*/
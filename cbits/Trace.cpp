@@ -0,0 +1,174 @@
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+#include "Trace.h"
+#include "Manager.h"
+
+// Buffered output is written to the file once it grows beyond this size
+static const int cTraceBufferSize = 64*1024;
+
+static QAtomicInt gTraceThreadNext(1);
+static thread_local int gTraceThread = 0;
+
+static void append_json_string(QByteArray& out, const QByteArray& str)
+{
+    out += '"';
+    for (int i=0; i<str.size(); i++) {
+        char c = str[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+HsQMLTracer::HsQMLTracer()
+    : mFile(NULL)
+    , mFirst(true)
+{
+    mClock.start();
+}
+
+HsQMLTracer::~HsQMLTracer()
+{
+    close();
+}
+
+bool HsQMLTracer::open(const QString& path)
+{
+    QMutexLocker locker(&mLock);
+    Q_ASSERT(!mFile);
+    mFile = std::fopen(QFile::encodeName(path).constData(), "wb");
+    if (!mFile) {
+        return false;
+    }
+
+    // Viewers accept the array format without the closing bracket, so the
+    // trace is still usable if the process dies before close() is called.
+    mBuffer = "[\n";
+    return true;
+}
+
+void HsQMLTracer::close()
+{
+    QMutexLocker locker(&mLock);
+    if (mFile) {
+        mBuffer += "\n]\n";
+        std::fwrite(mBuffer.constData(), 1, mBuffer.size(), mFile);
+        std::fclose(mFile);
+        mFile = NULL;
+        mBuffer.clear();
+    }
+}
+
+qint64 HsQMLTracer::now() const
+{
+    return mClock.nsecsElapsed();
+}
+
+void HsQMLTracer::addSpan(const char* cat,
+    const QByteArray& name, qint64 start, const QByteArray& args)
+{
+    qint64 end = now();
+    int tid = threadId();
+
+    QByteArray ev;
+    ev.reserve(160 + name.size() + args.size());
+    ev += "{\"name\":";
+    append_json_string(ev, name);
+    ev += ",\"cat\":\"";
+    ev += cat;
+    ev += "\",\"ph\":\"X\",\"ts\":";
+    ev += QByteArray::number(start/1000.0, 'f', 3);
+    ev += ",\"dur\":";
+    ev += QByteArray::number((end-start)/1000.0, 'f', 3);
+    ev += ",\"pid\":";
+    ev += QByteArray::number(QCoreApplication::applicationPid());
+    ev += ",\"tid\":";
+    ev += QByteArray::number(tid);
+    ev += ",\"args\":{";
+    ev += args;
+    ev += "}}";
+    append(ev);
+}
+
+int HsQMLTracer::threadId()
+{
+    if (gTraceThread) {
+        return gTraceThread;
+    }
+    gTraceThread = gTraceThreadNext.fetchAndAddRelaxed(1);
+
+    // Label the thread in the viewer with a metadata event
+    QByteArray name;
+    if (gManager->isEventThread()) {
+        name = "HsQML event loop";
+    }
+    else {
+        QThread* thread = QThread::currentThread();
+        name = thread->objectName().toUtf8();
+        if (name.isEmpty()) {
+            name = thread->metaObject()->className();
+        }
+    }
+    QByteArray ev("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+    ev += QByteArray::number(QCoreApplication::applicationPid());
+    ev += ",\"tid\":";
+    ev += QByteArray::number(gTraceThread);
+    ev += ",\"args\":{\"name\":";
+    append_json_string(ev, name);
+    ev += "}}";
+    append(ev);
+    return gTraceThread;
+}
+
+void HsQMLTracer::append(const QByteArray& ev)
+{
+    QMutexLocker locker(&mLock);
+    if (!mFile) {
+        return;
+    }
+    if (!mFirst) {
+        mBuffer += ",\n";
+    }
+    mFirst = false;
+    mBuffer += ev;
+    if (mBuffer.size() >= cTraceBufferSize) {
+        std::fwrite(mBuffer.constData(), 1, mBuffer.size(), mFile);
+        mBuffer.clear();
+    }
+}
+
+void HsQMLTraceSpan::addArg(const char* key, int value)
+{
+    if (!mArgs.isEmpty()) {
+        mArgs += ',';
+    }
+    mArgs += '"';
+    mArgs += key;
+    mArgs += "\":";
+    mArgs += QByteArray::number(value);
+}
+
+void HsQMLTraceSpan::addArg(const char* key, const QByteArray& value)
+{
+    if (!mArgs.isEmpty()) {
+        mArgs += ',';
+    }
+    mArgs += '"';
+    mArgs += key;
+    mArgs += "\":";
+    append_json_string(mArgs, value);
+}
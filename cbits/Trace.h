@@ -0,0 +1,80 @@
+#ifndef HSQML_TRACE_H
+#define HSQML_TRACE_H
+
+#include <cstdio>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+// Writes spans as Chrome trace event JSON, which can be loaded into
+// chrome://tracing or the Perfetto UI. Safe to use from any thread.
+class HsQMLTracer
+{
+public:
+    HsQMLTracer();
+    ~HsQMLTracer();
+    bool open(const QString&);
+    void close();
+    qint64 now() const;
+    void addSpan(const char*, const QByteArray&, qint64, const QByteArray&);
+
+private:
+    Q_DISABLE_COPY(HsQMLTracer)
+
+    int threadId();
+    void append(const QByteArray&);
+
+    QElapsedTimer mClock;
+    QMutex mLock;
+    std::FILE* mFile;
+    QByteArray mBuffer;
+    bool mFirst;
+};
+
+// Records the enclosing scope as a span. Does nothing if the tracer is NULL,
+// so callers should only build names and arguments when isActive().
+class HsQMLTraceSpan
+{
+public:
+    HsQMLTraceSpan(HsQMLTracer* tracer, const char* cat, const char* name = 0)
+        : mTracer(tracer)
+        , mCat(cat)
+        , mStart(tracer ? tracer->now() : 0)
+    {
+        if (tracer && name) {
+            mName = name;
+        }
+    }
+
+    ~HsQMLTraceSpan()
+    {
+        if (mTracer) {
+            mTracer->addSpan(mCat, mName, mStart, mArgs);
+        }
+    }
+
+    bool isActive() const
+    {
+        return mTracer;
+    }
+
+    void setName(const QByteArray& name)
+    {
+        mName = name;
+    }
+
+    void addArg(const char*, int);
+    void addArg(const char*, const QByteArray&);
+
+private:
+    Q_DISABLE_COPY(HsQMLTraceSpan)
+
+    HsQMLTracer* mTracer;
+    const char* mCat;
+    qint64 mStart;
+    QByteArray mName;
+    QByteArray mArgs;
+};
+
+#endif /*HSQML_TRACE_H*/
@@ -16,25 +16,38 @@ extern void hsqml_init(
 /* Event Loop */
 typedef void (*HsQMLTrivialCb)();
 
+typedef void (*HsQMLJobsCb)(HsStablePtr*, int);
+
 typedef enum {
     HSQML_EVLOOP_OK = 0,
     HSQML_EVLOOP_ALREADY_RUNNING,
     HSQML_EVLOOP_POST_SHUTDOWN,
     HSQML_EVLOOP_WRONG_THREAD,
     HSQML_EVLOOP_NOT_RUNNING,
+    HSQML_EVLOOP_STARTING,
     HSQML_EVLOOP_OTHER_ERROR
 } HsQMLEventLoopStatus;
 
 extern HsQMLEventLoopStatus hsqml_evloop_run(
     HsQMLTrivialCb startCb,
-    HsQMLTrivialCb jobsCb,
+    HsQMLJobsCb jobsCb,
     HsQMLTrivialCb yieldCb);
 
 extern HsQMLEventLoopStatus hsqml_evloop_require();
 
 extern void hsqml_evloop_release();
 
-extern void hsqml_evloop_notify_jobs();
+typedef enum {
+    HSQML_JOB_INTERACTIVE = 0,
+    HSQML_JOB_NORMAL,
+    HSQML_JOB_BACKGROUND
+} HsQMLJobPriority;
+
+extern void hsqml_evloop_post_job(HsStablePtr, HsQMLJobPriority);
+
+extern void hsqml_evloop_set_job_budget(int);
+
+extern int hsqml_evloop_get_job_backlog();
 
 extern HsQMLEventLoopStatus hsqml_evloop_shutdown();
 
@@ -145,6 +158,12 @@ extern HsQMLObjectHandle* hsqml_create_object(
 extern int hsqml_object_set_active(
     HsQMLObjectHandle*);
 
+extern int hsqml_object_get_engines(
+    HsQMLObjectHandle*, void**, int);
+
+extern int hsqml_object_set_active_engine(
+    HsQMLObjectHandle*, void*);
+
 extern HsStablePtr hsqml_object_get_hs_typerep(
     HsQMLObjectHandle*);
 
@@ -189,6 +208,14 @@ extern void hsqml_finalise_obj_finaliser(
 extern void hsqml_object_add_finaliser(
     HsQMLObjectHandle*, HsQMLObjFinaliserHandle*);
 
+/* Object Pools */
+typedef enum {
+    HSQML_POOL_OBJ_PROXY,
+    HSQML_POOL_QOBJECT
+} HsQMLPoolId;
+
+extern int hsqml_get_pool_stats(HsQMLPoolId, long long*, int);
+
 /* Global */
 extern int hsqml_set_args(HsQMLStringHandle**);
 
@@ -199,6 +226,9 @@ extern void hsqml_get_args(HsQMLStringHandle**);
 typedef enum {
     HSQML_GFLAG_SHARE_OPENGL_CONTEXTS,
     HSQML_GFLAG_ENABLE_QML_DEBUG,
+    HSQML_GFLAG_FRAME_SYNC_JOBS,
+    HSQML_GFLAG_GUI_APPLICATION,
+    HSQML_GFLAG_CORE_APPLICATION,
 } HsQMLGlobalFlag;
 
 extern int hsqml_set_flag(HsQMLGlobalFlag, int);
@@ -207,6 +237,58 @@ extern int hsqml_get_flag(HsQMLGlobalFlag);
 
 extern void hsqml_set_debug_loglevel(int);
 
+extern int hsqml_get_counters(int*, int);
+
+typedef enum {
+    HSQML_METACALL_METHOD = 0,
+    HSQML_METACALL_READ,
+    HSQML_METACALL_WRITE
+} HsQMLMetaCallKind;
+
+typedef void (*HsQMLMetaCallStatsCb)(
+    const char*, const char*, HsQMLMetaCallKind, int, const int*, int);
+
+extern void hsqml_set_metacall_profiling(int);
+
+extern void hsqml_get_metacall_stats(HsQMLMetaCallStatsCb);
+
+typedef enum {
+    HSQML_STALL_METHOD = 0,
+    HSQML_STALL_PROPERTY_READ,
+    HSQML_STALL_PROPERTY_WRITE,
+    HSQML_STALL_JOBS,
+    HSQML_STALL_START,
+    HSQML_STALL_YIELD,
+    HSQML_STALL_FINALISER,
+    HSQML_STALL_CANVAS_DELEGATE,
+    HSQML_STALL_CANVAS_SETUP,
+    HSQML_STALL_CANVAS_SYNC,
+    HSQML_STALL_CANVAS_PAINT,
+    HSQML_STALL_CANVAS_CLEANUP
+} HsQMLStallSite;
+
+extern void hsqml_set_stall_threshold(int);
+
+extern int hsqml_get_worst_stalls(int*, long long*, long long*, int);
+
+extern int hsqml_get_stall_summary(long long*, int);
+
+typedef enum {
+    HSQML_STARTUP_INIT = 0,
+    HSQML_STARTUP_EVLOOP_START,
+    HSQML_STARTUP_APP_CREATED,
+    HSQML_STARTUP_DEBUG_READY,
+    HSQML_STARTUP_TYPES_REGISTERED,
+    HSQML_STARTUP_LOAD_STARTED,
+    HSQML_STARTUP_COMPONENT_READY,
+    HSQML_STARTUP_COMPONENT_CREATED,
+    HSQML_STARTUP_FIRST_FRAME
+} HsQMLStartupPhase;
+
+extern int hsqml_get_startup_timeline(long long*, int);
+
+extern int hsqml_get_zombie_stats(long long*, int);
+
 /* Engine */
 typedef char HsQMLEngineHandle;
 
@@ -1,9 +1,45 @@
 -- | Debug Options
+--
+-- If the environment variable @HSQML_TRACE_FILE@ is set to a path when the
+-- library is initialised, then a timeline of method calls, property accesses,
+-- jobs, garbage collector lock releases, engine creation and canvas rendering
+-- is written to that file. The file uses the Chrome trace event format and
+-- can be opened in @chrome:\/\/tracing@ or the Perfetto UI.
 module Graphics.QML.Debug (
-    setDebugLogLevel
+    setDebugLogLevel,
+    getJobBacklog,
+    Counters(..),
+    getCounters,
+    MetaCallKind(..),
+    MetaCallStats(..),
+    setMetaCallProfiling,
+    getMetaCallStats,
+    ZombieStats(..),
+    getZombieStats,
+    Pool(..),
+    PoolStats(..),
+    getPoolStats,
+    StartupPhase(..),
+    getStartupTimeline,
+    StallSite(..),
+    Stall(..),
+    StallSummary(..),
+    setStallThreshold,
+    getWorstStalls,
+    getStallSummary
 ) where
 
 import Graphics.QML.Internal.BindCore
+import Graphics.QML.Internal.BindPrim
+
+import qualified Data.ByteString as BS
+import Data.IORef
+import Data.Text (Text)
+import qualified Data.Text.Encoding as T
+import Foreign.C.Types
+import Foreign.Marshal.Array
+import Data.Word
+import Foreign.Ptr
 
 -- | Sets the global debug log level. At level zero, no logging information
 -- will be printed. Higher levels will increase debug verbosity.
@@ -11,3 +47,291 @@ setDebugLogLevel :: Int -> IO ()
 setDebugLogLevel lvl = do
     hsqmlInit
     hsqmlSetDebugLoglevel lvl
+
+-- | Returns the number of jobs which were left pending when the event loop
+-- last ran out of its job time budget (see
+-- 'Graphics.QML.Engine.setJobTimeBudget'), or zero if the last batch of jobs
+-- was completed.
+getJobBacklog :: IO Int
+getJobBacklog = do
+    hsqmlInit
+    hsqmlEvloopGetJobBacklog
+
+-- | Snapshot of the library's internal resource counters.
+data Counters = Counters {
+    -- | Number of live classes.
+    counterClasses :: Int,
+    -- | Number of live object handles.
+    counterObjects :: Int,
+    -- | Number of live Qt objects backing object handles.
+    counterQObjects :: Int,
+    -- | Number of QVariants on the heap which reference objects.
+    counterVariants :: Int,
+    -- | Number of live engines.
+    counterEngines :: Int,
+    -- | Total number of classes created.
+    counterClassesCreated :: Int,
+    -- | Total number of object handles created.
+    counterObjectsCreated :: Int,
+    -- | Total number of engines created.
+    counterEnginesCreated :: Int
+} deriving (Eq, Show)
+
+-- | Returns the current values of the internal resource counters. This does
+-- not require debug logging to be enabled and is cheap enough to poll.
+getCounters :: IO Counters
+getCounters = do
+    hsqmlInit
+    allocaArray counterCount $ \ptr -> do
+        _ <- hsqmlGetCounters ptr counterCount
+        vs <- peekArray counterCount (ptr :: Ptr CInt)
+        let v = fromIntegral . (vs !!)
+        return $ Counters (v 0) (v 1) (v 2) (v 3) (v 4) (v 5) (v 6) (v 7)
+    where counterCount = 8
+
+-- | Kind of call made from QML into a Haskell object.
+data MetaCallKind
+    = MethodCall
+    | PropertyRead
+    | PropertyWrite
+    deriving (Eq, Ord, Show, Bounded, Enum)
+
+-- | Call statistics for one member of a class.
+data MetaCallStats = MetaCallStats {
+    -- | Name of the class.
+    metaCallClass :: Text,
+    -- | Name of the method or property.
+    metaCallMember :: Text,
+    -- | Kind of call.
+    metaCallKind :: MetaCallKind,
+    -- | Number of calls made.
+    metaCallCount :: Int,
+    -- | Latency histogram, where the count at index @i@ is the number of calls
+    -- which took between 2^i and 2^(i+1) nanoseconds.
+    metaCallHistogram :: [Int]
+} deriving (Eq, Show)
+
+-- | Enables or disables recording the latency of each call made from QML
+-- into methods and properties of Haskell objects. Recording is disabled by
+-- default and statistics already gathered are kept when it is disabled.
+setMetaCallProfiling :: Bool -> IO ()
+setMetaCallProfiling enable = do
+    hsqmlInit
+    hsqmlSetMetacallProfiling enable
+
+-- | Returns the statistics recorded for each member which has been called
+-- while profiling was enabled (see 'setMetaCallProfiling').
+getMetaCallStats :: IO [MetaCallStats]
+getMetaCallStats = do
+    hsqmlInit
+    ref <- newIORef []
+    hsqmlGetMetacallStats $ \cls mem kind count buckets len -> do
+        clsName <- T.decodeUtf8 <$> BS.packCString cls
+        memName <- T.decodeUtf8 <$> BS.packCString mem
+        hist <- map fromIntegral <$> peekArray (fromIntegral len) buckets
+        modifyIORef ref (MetaCallStats clsName memName
+            (externalKind $ cIntToEnum kind) (fromIntegral count) hist :)
+    reverse <$> readIORef ref
+
+externalKind :: HsQMLMetaCallKind -> MetaCallKind
+externalKind HsqmlMetacallMethod = MethodCall
+externalKind HsqmlMetacallRead = PropertyRead
+externalKind HsqmlMetacallWrite = PropertyWrite
+
+-- | Statistics about dead classes. Qt keeps pointers to the meta-objects of
+-- classes without any way of releasing them, so a class's meta-object and
+-- strings stay in memory after it is garbage collected. A new class with the
+-- same members as a dead one reuses its meta-object, so only structurally
+-- distinct classes pin memory.
+data ZombieStats = ZombieStats {
+    -- | Number of dead classes waiting to be reused.
+    zombieClasses :: Int,
+    -- | Bytes of memory pinned by dead classes.
+    zombieBytes :: Int,
+    -- | Number of classes created by reusing a dead class.
+    zombieRevivals :: Int
+} deriving (Eq, Show)
+
+-- | Returns statistics about dead classes.
+getZombieStats :: IO ZombieStats
+getZombieStats = do
+    hsqmlInit
+    allocaArray statCount $ \ptr -> do
+        _ <- hsqmlGetZombieStats ptr statCount
+        vs <- peekArray statCount (ptr :: Ptr CLLong)
+        let v = fromIntegral . (vs !!)
+        return $ ZombieStats (v 0) (v 1) (v 2)
+    where statCount = 3
+
+-- | Allocation pool used by the library for its per-object data.
+data Pool
+    -- | Pool for the proxies which link Haskell objects to their QObjects.
+    = ObjectProxyPool
+    -- | Pool for the QObjects created when objects are passed to QML.
+    | QObjectPool
+    deriving (Eq, Ord, Bounded, Enum, Show)
+
+-- | Statistics about an allocation pool. Blocks are carved from slabs of
+-- memory which are kept for reuse rather than returned to the system.
+data PoolStats = PoolStats {
+    -- | Size in bytes of each block.
+    poolBlockSize :: Int,
+    -- | Number of slabs allocated.
+    poolSlabs :: Int,
+    -- | Bytes of memory reserved by the slabs.
+    poolReservedBytes :: Int,
+    -- | Number of blocks in use.
+    poolBlocksInUse :: Int,
+    -- | Number of blocks free for reuse.
+    poolBlocksFree :: Int
+} deriving (Eq, Show)
+
+-- | Returns statistics about an allocation pool.
+getPoolStats :: Pool -> IO PoolStats
+getPoolStats pool = do
+    hsqmlInit
+    allocaArray statCount $ \ptr -> do
+        _ <- hsqmlGetPoolStats (internalPool pool) ptr statCount
+        vs <- peekArray statCount (ptr :: Ptr CLLong)
+        let v = fromIntegral . (vs !!)
+        return $ PoolStats (v 0) (v 1) (v 2) (v 3) (v 4)
+    where statCount = 5
+
+internalPool :: Pool -> HsQMLPoolId
+internalPool ObjectProxyPool = HsqmlPoolObjProxy
+internalPool QObjectPool = HsqmlPoolQobject
+
+-- | Milestone in starting the library and showing the first window.
+data StartupPhase
+    -- | The library was initialised.
+    = StartupInit
+    -- | The event loop was first started, before creating the application.
+    | StartupEventLoop
+    -- | The Qt application object was created.
+    | StartupAppCreated
+    -- | The QML debugger, if enabled, was set up.
+    | StartupDebugReady
+    -- | The library's QML types were registered.
+    | StartupTypesRegistered
+    -- | The first engine started loading its document.
+    | StartupLoadStarted
+    -- | The first document was compiled and ready to create.
+    | StartupComponentReady
+    -- | The first document's root object was created.
+    | StartupComponentCreated
+    -- | The first frame was swapped onto the screen.
+    | StartupFirstFrame
+    deriving (Eq, Ord, Show, Bounded, Enum)
+
+-- | Returns the monotonic time in nanoseconds at which each startup phase
+-- was first reached, in order, omitting phases which haven't been reached
+-- yet. Times use the same clock as 'Stall' start times. The phases are also
+-- logged as they are reached at debug log level 1 and above.
+getStartupTimeline :: IO [(StartupPhase, Word64)]
+getStartupTimeline = do
+    hsqmlInit
+    allocaArray phaseCount $ \ptr -> do
+        _ <- hsqmlGetStartupTimeline ptr phaseCount
+        ts <- peekArray phaseCount (ptr :: Ptr CLLong)
+        return [(phase, fromIntegral t) |
+            (phase, t) <- zip [minBound .. maxBound] ts, t /= 0]
+    where phaseCount = fromEnum (maxBound :: StartupPhase) + 1
+
+-- | Place where a Qt thread calls into Haskell and waits for it to return.
+data StallSite
+    = StallMethod
+    | StallPropertyRead
+    | StallPropertyWrite
+    | StallJobs
+    | StallStart
+    | StallYield
+    | StallFinaliser
+    | StallCanvasDelegate
+    | StallCanvasSetup
+    | StallCanvasSync
+    | StallCanvasPaint
+    | StallCanvasCleanup
+    deriving (Eq, Ord, Show, Bounded, Enum)
+
+-- | A call into Haskell which took longer than the stall threshold.
+data Stall = Stall {
+    -- | Where the call was made.
+    stallSite :: StallSite,
+    -- | Monotonic time in nanoseconds at which the call was made. This uses
+    -- the same clock as 'GHC.Clock.getMonotonicTimeNSec' on most platforms,
+    -- so stalls can be compared against garbage collection events.
+    stallStart :: Word64,
+    -- | Time in nanoseconds spent in the call.
+    stallDuration :: Word64
+} deriving (Eq, Show)
+
+-- | Totals for the calls made at one stall site.
+data StallSummary = StallSummary {
+    -- | Where the calls were made.
+    stallSummarySite :: StallSite,
+    -- | Number of calls made.
+    stallSummaryCalls :: Int,
+    -- | Number of calls which exceeded the threshold.
+    stallSummaryStalls :: Int,
+    -- | Total time in nanoseconds spent in calls which exceeded the threshold.
+    stallSummaryTime :: Word64,
+    -- | Longest time in nanoseconds spent in a single call.
+    stallSummaryMaxTime :: Word64
+} deriving (Eq, Show)
+
+-- | Sets the threshold in microseconds above which calls from Qt threads
+-- into Haskell are recorded and logged as stalls, or disables stall
+-- profiling if 'Nothing'. Profiling is disabled by default and any previous
+-- statistics are discarded when the threshold is changed.
+setStallThreshold :: Maybe Int -> IO ()
+setStallThreshold thr = do
+    hsqmlInit
+    hsqmlSetStallThreshold $ maybe 0 (max 1) thr
+
+-- | Returns the longest stalls recorded since the threshold was last set,
+-- longest first.
+getWorstStalls :: IO [Stall]
+getWorstStalls = do
+    hsqmlInit
+    allocaArray maxStalls $ \sitePtr ->
+        allocaArray maxStalls $ \startPtr ->
+        allocaArray maxStalls $ \durPtr -> do
+            n <- hsqmlGetWorstStalls sitePtr startPtr durPtr maxStalls
+            sites <- peekArray n sitePtr
+            starts <- peekArray n startPtr
+            durs <- peekArray n durPtr
+            return $ zipWith3 (\site start dur -> Stall
+                (externalSite $ cIntToEnum site)
+                (fromIntegral start) (fromIntegral dur)) sites starts durs
+    where maxStalls = 32
+
+-- | Returns totals for every stall site since the threshold was last set.
+getStallSummary :: IO [StallSummary]
+getStallSummary = do
+    hsqmlInit
+    allocaArray valueCount $ \ptr -> do
+        _ <- hsqmlGetStallSummary ptr valueCount
+        vs <- peekArray valueCount (ptr :: Ptr CLLong)
+        return $ zipWith summary [minBound .. maxBound] $ chunks vs
+    where siteCount = fromEnum (maxBound :: StallSite) + 1
+          valueCount = 4 * siteCount
+          summary site [calls, stalls, time, maxTime] =
+              StallSummary site (fromIntegral calls) (fromIntegral stalls)
+                  (fromIntegral time) (fromIntegral maxTime)
+          summary site _ = StallSummary site 0 0 0 0
+          chunks [] = []
+          chunks xs = let (c, xs') = splitAt 4 xs in c : chunks xs'
+
+externalSite :: HsQMLStallSite -> StallSite
+externalSite HsqmlStallMethod = StallMethod
+externalSite HsqmlStallPropertyRead = StallPropertyRead
+externalSite HsqmlStallPropertyWrite = StallPropertyWrite
+externalSite HsqmlStallJobs = StallJobs
+externalSite HsqmlStallStart = StallStart
+externalSite HsqmlStallYield = StallYield
+externalSite HsqmlStallFinaliser = StallFinaliser
+externalSite HsqmlStallCanvasDelegate = StallCanvasDelegate
+externalSite HsqmlStallCanvasSetup = StallCanvasSetup
+externalSite HsqmlStallCanvasSync = StallCanvasSync
+externalSite HsqmlStallCanvasPaint = StallCanvasPaint
+externalSite HsqmlStallCanvasCleanup = StallCanvasCleanup
@@ -33,9 +33,11 @@ module Graphics.QML.Engine (
   getQtArgs,
   QtFlag(
     QtShareOpenGLContexts,
-    QtEnableQMLDebug),
+    QtEnableQMLDebug,
+    QtFrameSyncJobs),
   setQtFlag,
   getQtFlag,
+  setJobTimeBudget,
   shutdownQt,
   EventLoopException(),
 
@@ -235,15 +237,18 @@ tryRunInBoundThread action =
 -- loop. Callers must apply their own sychronisation to ensure that the event
 -- loop is currently running when this function is called, otherwise an
 -- 'EventLoopException' will be thrown. The event loop will not exit until the
--- supplied function has completed.
+-- supplied function has completed. If the event loop is still starting up
+-- then this function waits until it is running.
 requireEventLoop :: RunQML a -> IO a
 requireEventLoop (RunQML runFn) = do
     hsqmlInit
     let reqFn = do
             status <- hsqmlEvloopRequire
-            case statusException status of
-                Just ex -> throw ex
-                Nothing -> return ()
+            case status of
+                HsqmlEvloopStarting -> threadDelay 1000 >> reqFn
+                _ -> case statusException status of
+                    Just ex -> throw ex
+                    Nothing -> return ()
     bracket_ reqFn hsqmlEvloopRelease runFn
 
 -- | Sets the program name and command line arguments used by Qt and returns
@@ -277,11 +282,27 @@ data QtFlag
     -- order to use QtWebEngine. 
     = QtShareOpenGLContexts
     | QtEnableQMLDebug
+    -- | Defers jobs posted from other threads (e.g. by 'fireSignal') until
+    -- the next frame of an engine's window is about to be synchronised, so
+    -- that all the changes from one batch appear in the same frame. Requires
+    -- Qt 5.3 or later.
+    | QtFrameSyncJobs
+    -- | Creates a @QGuiApplication@ instead of a @QApplication@, so that
+    -- QtWidgets and its style plugins are never initialised. Qt Quick
+    -- doesn't need widgets, but some QML modules such as Qt Charts do.
+    | QtGuiApplication
+    -- | Creates a @QCoreApplication@ for headless use. Windows and canvases
+    -- are not available, and the @HsQML.Clipboard@ module is not registered
+    -- so importing it fails. Takes precedence over 'QtGuiApplication'.
+    | QtCoreApplication
     deriving Show
 
 internalFlag :: QtFlag -> HsQMLGlobalFlag
 internalFlag QtShareOpenGLContexts = HsqmlGflagShareOpenglContexts
 internalFlag QtEnableQMLDebug = HsqmlGflagEnableQmlDebug
+internalFlag QtFrameSyncJobs = HsqmlGflagFrameSyncJobs
+internalFlag QtGuiApplication = HsqmlGflagGuiApplication
+internalFlag QtCoreApplication = HsqmlGflagCoreApplication
 
 -- | Sets or clears one of the application flags used by Qt and returns True
 -- if successful. If the flag or flag value is not supported then it will
@@ -296,6 +317,16 @@ setQtFlag flag val = do
 getQtFlag :: QtFlag -> RunQML Bool
 getQtFlag = RunQML . hsqmlGetFlag . internalFlag
 
+-- | Sets the maximum time in microseconds which the event loop will spend
+-- running jobs posted from other threads (e.g. by 'fireSignal') before
+-- yielding back to Qt so that rendering and input can proceed. Any jobs left
+-- over are run in a later iteration of the event loop. By default, or if
+-- 'Nothing' is given, all pending jobs are run at once.
+setJobTimeBudget :: Maybe Int -> IO ()
+setJobTimeBudget budget = do
+    hsqmlInit
+    hsqmlEvloopSetJobBudget $ maybe 0 (max 1) budget
+
 -- | Shuts down and frees resources used by the Qt framework, preventing
 -- further use of the event loop. The framework is initialised when
 -- 'runEventLoop' is first called and remains initialised afterwards so that
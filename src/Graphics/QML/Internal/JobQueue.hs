@@ -1,25 +1,52 @@
 module Graphics.QML.Internal.JobQueue (
+    JobPriority(
+        InteractiveJob,
+        NormalJob,
+        BackgroundJob),
     postJob,
+    postJobWith,
     processJobs
 ) where
 
 import Graphics.QML.Internal.BindCore
 
-import Control.Concurrent.MVar
-import System.IO.Unsafe
+import Control.Monad
+import Foreign.C.Types
+import Foreign.Marshal.Array
+import Foreign.Ptr
+import Foreign.StablePtr
 
-{-# NOINLINE jobQueue #-}
-jobQueue :: MVar [IO ()]
-jobQueue = unsafePerformIO $ newMVar []
+-- | Specifies how urgently work posted to the event loop thread is run.
+-- Pending jobs of a higher priority are always run before those of a lower
+-- priority.
+data JobPriority
+    -- | For work which directly follows from user input.
+    = InteractiveJob
+    -- | The default priority.
+    | NormalJob
+    -- | For bulk work such as loading data. Background jobs also wait behind
+    -- Qt's own pending events, such as those for user input.
+    | BackgroundJob
+    deriving (Eq, Ord, Show, Enum, Bounded)
+
+internalPriority :: JobPriority -> HsQMLJobPriority
+internalPriority InteractiveJob = HsqmlJobInteractive
+internalPriority NormalJob = HsqmlJobNormal
+internalPriority BackgroundJob = HsqmlJobBackground
 
 postJob :: IO () -> IO ()
-postJob j = do
-    notify <- modifyMVar jobQueue $ \js -> return (j:js,null js)
-    if notify
-    then hsqmlEvloopNotifyJobs 
-    else return ()
+postJob = postJobWith NormalJob
+
+postJobWith :: JobPriority -> IO () -> IO ()
+postJobWith prio j = do
+    sPtr <- newStablePtr j
+    hsqmlEvloopPostJob (castStablePtrToPtr sPtr) (internalPriority prio)
 
-processJobs :: IO ()
-processJobs = do
-    js <- modifyMVar jobQueue $ \js -> return ([],js)
-    sequence_ $ reverse js
+processJobs :: Ptr (Ptr ()) -> CInt -> IO ()
+processJobs ptr n = do
+    js <- peekArray (fromIntegral n) ptr
+    forM_ js $ \p -> do
+        let sPtr = castPtrToStablePtr p
+        j <- deRefStablePtr sPtr
+        freeStablePtr sPtr
+        j
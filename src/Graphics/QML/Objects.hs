@@ -36,6 +36,11 @@ module Graphics.QML.Objects (
   defSignal,
   defSignalNamedParams,
   fireSignal,
+  fireSignalWith,
+  JobPriority(
+    InteractiveJob,
+    NormalJob,
+    BackgroundJob),
   SignalKey,
   newSignalKey,
   SignalKeyClass (
@@ -346,14 +351,24 @@ defSignalNamedParams name key pnames =
 fireSignal ::
     forall tt skv. (Marshal tt,
         SignalKeyValue skv) => skv -> tt -> SignalValueParams skv
-fireSignal key this =
-    let start cnt = postJob $ do
+fireSignal = fireSignalWith NormalJob
+
+-- | Fires a signal in the same manner as 'fireSignal', but with the given
+-- priority relative to other work pending on the event loop thread. This
+-- allows signals triggered by user actions to overtake a backlog of
+-- background updates.
+fireSignalWith ::
+    forall tt skv. (Marshal tt,
+        SignalKeyValue skv) =>
+    JobPriority -> skv -> tt -> SignalValueParams skv
+fireSignalWith prio key this =
+    let start cnt = postJobWith prio $ do
            hndl <- mToHndl this
            info <- hsqmlObjectGetHsTyperep hndl
            let slotMay = Map.lookup (signalKey key) $ cinfoSignals info
            case slotMay of
                 Just slotIdx ->
-                    withActiveObject hndl $ cnt $ SignalData hndl slotIdx
+                    withEachActiveObject hndl $ cnt $ SignalData hndl slotIdx
                 Nothing ->
                     return () -- Should warn?
         cont ps (SignalData hndl slotIdx) =
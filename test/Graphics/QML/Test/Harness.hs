@@ -47,19 +47,23 @@ finishTest mock = do
             _                            -> status
     writeIORef statusRef status'
 
-runTest :: (TestAction a) => TestBoxSrc a -> IO TestStatus
-runTest src = do
-    let js = showTestCode (srcTestBoxes src) ""
+runScript :: String -> AnyObjRef -> IO ()
+runScript js go = do
     tmpDir <- getTemporaryDirectory
     (qmlPath, hndl) <- openTempFile tmpDir "test1-.qml"
     hPutStr hndl (qmlPrelude ++ js ++ qmlPostscript)
     hClose hndl
-    mock <- mockFromSrc src
-    go <- newObjectDC mock
     runEngineLoop defaultEngineConfig {
         initialDocument = fileDocument qmlPath,
-        contextObject = Just $ anyObjRef go}
+        contextObject = Just go}
     removeFile qmlPath
+
+runTest :: (TestAction a) => TestBoxSrc a -> IO TestStatus
+runTest src = do
+    let js = showTestCode (srcTestBoxes src) ""
+    mock <- mockFromSrc src
+    go <- newObjectDC mock
+    runScript js $ anyObjRef go
     finishTest mock
     status <- readIORef (mockStatus mock)
     if isJust $ testFault status
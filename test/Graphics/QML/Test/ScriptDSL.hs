@@ -139,6 +139,11 @@ connect sig fn = eval $ sig `dot` "connect" `call` [fn]
 disconnect :: Expr -> Expr -> Prog
 disconnect sig fn = eval $ sig `dot` "disconnect" `call` [fn]
 
+loop :: Int -> Prog -> Prog
+loop n (Prog a b) =
+    Prog (showString "for (var i = 0; i < " . shows n .
+        showString "; i++) {\n" . a . b . showString "}\n") id
+
 makeCont :: [String] -> Prog -> Prog
 makeCont args (Prog a b) =
     Prog (showString "var cont = function(" . farg . showString ") {\n")